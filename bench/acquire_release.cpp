@@ -0,0 +1,70 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConnectionPool.h"
+
+/**
+ * @brief Measures GetConnecion/ReleaseConnecion throughput.
+ *
+ * Usage: bench_acquire_release <config file> [threads] [iterations per thread]
+ *
+ * The config file uses the same format as example/config.txt. No query is
+ * sent, so the numbers reflect the pool's own bookkeeping.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <config file> [threads] [iterations]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    PoolOptions options;
+    std::string error;
+    if (!options.LoadFile(argv[1], error))
+    {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    options.LoadEnv();
+    options.verbose = false;
+
+    int numThreads = argc > 2 ? std::stoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    long iterations = argc > 3 ? std::stol(argv[3]) : 1000000;
+
+    ConnectionPool pool(options);
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++)
+    {
+        threads.emplace_back([&pool, &start, iterations]() {
+            while (!start)
+                std::this_thread::yield();
+            for (long i = 0; i < iterations; i++)
+            {
+                SQLConnection *sqlPtr = pool.GetConnecion();
+                if (sqlPtr != nullptr)
+                    pool.ReleaseConnecion(sqlPtr);
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto &thread : threads)
+        thread.join();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    double total = (double)numThreads * iterations;
+    std::cout << "threads=" << numThreads
+              << " connections=" << options.numConnection
+              << " ops=" << (long)total
+              << " seconds=" << elapsed
+              << " ops_per_sec=" << (long)(total / elapsed)
+              << " ns_per_op=" << (elapsed * 1e9 / total) << std::endl;
+    return EXIT_SUCCESS;
+}
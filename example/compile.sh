@@ -1,7 +1,8 @@
 #!/bin/bash
-gcc -std=c++11 -g \
+gcc -std=c++11 -O2 \
 -I$(pwd) \
 -I$(pwd)/../ \
+-I$(pwd)/../src \
 -I/usr/include/mysql \
 -L/usr/lib64/mysql \
-main.cpp -lstdc++ -lpthread -lmysqlclient -o example
+main.cpp ../src/*.cpp -lstdc++ -lpthread -lmysqlclient -o example
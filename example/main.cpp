@@ -10,6 +10,8 @@
 #include <iostream>
 #include <memory>
 #include "./src/ConnectionPool.h"
+#include "./src/PoolConfigWatcher.h"
+#include "./src/QueryBuilder.h"
 
 bool running = true;
 
@@ -56,29 +58,29 @@ class DatabaseManager
 {
 private:
     std::shared_ptr<ConnectionPool> connPool;
+    std::unique_ptr<PoolConfigWatcher> configWatcher;
 
 public:
     /**
      * @brief The Constructor for DatabaseManager class.
      * 
-     * Used to initialize the connection pool.
+     * Used to initialize the connection pool and reload it when the
+     * configuration file changes.
      * 
-     * @param host mysql server name or ip address.
-     * @param port mysql server port.
-     * @param user mysql user name.
-     * @param password mysql user password.
-     * @param database mysql database name.
+     * @param options connection pool options.
+     * @param configFile configuration file the options were read from.
      * 
      */
-    DatabaseManager(std::string host, int port, std::string user, std::string password, std::string database)
+    DatabaseManager(const PoolOptions &options, std::string configFile)
     {
-        size_t NUM_CONNS = 3;
-        connPool.reset(new ConnectionPool(host, port, user, password, database, NUM_CONNS));
+        connPool.reset(new ConnectionPool(options));
         if (!connPool->HasActiveConnections())
         {
             std::cerr << "Error Initializing connection pool!" << std::endl;
             exit(EXIT_FAILURE);
         }
+        configWatcher.reset(new PoolConfigWatcher(connPool.get(), configFile));
+        configWatcher->Start();
         std::cout << "Connection Initialized!" << std::endl;
     }
     /**
@@ -93,9 +95,10 @@ public:
         auto sqlPtr = connPool->GetConnecion();
         std::thread([this, sqlPtr, table]() {
             std::string error;
-            std::stringstream ssquery;
-            ssquery << "select * from " << sqlPtr->getDatabase() << ".`" << table << "`";
-            auto results = sqlPtr->selectQuery(ssquery.str(), error);
+            QueryBuilder query(sqlPtr);
+            query.append("select * from ").identifier(sqlPtr->getDatabase())
+                .append(".").identifier(table);
+            auto results = query.select(error);
             if (error.length() > 0) {
                 std::cout << error << std::endl;
             } else {
@@ -130,14 +133,18 @@ int main(int argc, char **argv)
     ssdbfile << programDir << "/config.txt";
     auto dbconfigs = ReadConfigFile(ssdbfile.str());
 
-    std::string host = dbconfigs.at("dbhost");
-    int port = std::stoi(dbconfigs.at("port"));
-    std::string database = dbconfigs.at("database");
-    std::string user = dbconfigs.at("user");
-    std::string password = dbconfigs.at("password");
     std::string table = dbconfigs.at("table");
 
-    DatabaseManager dbManager(host, port, user, password, database);
+    PoolOptions options;
+    std::string error;
+    if (!options.LoadFile(ssdbfile.str(), error))
+    {
+        std::cerr << error << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    options.LoadEnv();
+
+    DatabaseManager dbManager(options, ssdbfile.str());
     while (running)
     {
         dbManager.doDatabaseOperation(table);
@@ -0,0 +1,177 @@
+#include "BatchLoader.h"
+
+#include <iostream>
+
+#include "QueryBuilder.h"
+
+const unsigned int BatchLoader::DEFAULT_MAX_BATCH;
+const unsigned int BatchLoader::DEFAULT_WINDOW_MS;
+
+/**
+ * @brief Construct a new Batch Loader:: Batch Loader object
+ *
+ * Starts the collector thread.
+ *
+ * @param pool pool the batches lease connections from, must outlive the loader.
+ * @param table table name, may be qualified as database.table.
+ * @param keyColumn column the keys are looked up in.
+ * @param columns select list returned for each key, raw SQL.
+ * A bare "*" is qualified with the table, as it cannot follow the key.
+ * @param maxBatch most distinct keys sent in one query.
+ * @param windowMs how long the first key of a batch waits for others.
+ */
+BatchLoader::BatchLoader(
+    ConnectionPool *pool, const std::string &table,
+    const std::string &keyColumn, const std::string &columns,
+    unsigned int maxBatch, unsigned int windowMs)
+{
+    this->pool = pool;
+    this->table = table;
+    this->keyColumn = keyColumn;
+    this->columns = columns == "*" ? table + ".*" : columns;
+    this->maxBatch = maxBatch > 0 ? maxBatch : 1;
+    this->window = std::chrono::milliseconds(windowMs);
+    this->running = true;
+
+    collectorThread = std::thread(&BatchLoader::collectorLoop, this);
+}
+
+BatchLoader::~BatchLoader()
+{
+    Stop();
+}
+
+/**
+ * @brief Queue a key for the next batch.
+ *
+ * Requests for a key already waiting share its query.
+ *
+ * @returns future holding the row, or found=false if no row has that key.
+ */
+std::future<LoadResult> BatchLoader::Load(const std::string &key)
+{
+    std::promise<LoadResult> promise;
+    std::future<LoadResult> future = promise.get_future();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running)
+    {
+        LoadResult result;
+        result.error = "ERROR: Batch loader is stopped.";
+        promise.set_value(std::move(result));
+        return future;
+    }
+    if (pending.empty())
+        oldest = std::chrono::steady_clock::now();
+    pending[key].push_back(std::move(promise));
+    if (pending.size() == 1 || pending.size() >= maxBatch)
+        wakeup.notify_one();
+    return future;
+}
+
+/**
+ * @brief Stop the collector thread. Keys still waiting are fetched first.
+ */
+void BatchLoader::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeup.notify_one();
+    if (collectorThread.joinable())
+        collectorThread.join();
+}
+
+void BatchLoader::collectorLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wakeup.wait(lock, [this]() { return !running || !pending.empty(); });
+        if (pending.empty())
+            break;
+
+        // let other keys join until the window closes or the batch is full
+        wakeup.wait_until(lock, oldest + window, [this]() {
+            return !running || pending.size() >= maxBatch;
+        });
+
+        std::map<std::string, std::vector<std::promise<LoadResult>>> batch;
+        while (!pending.empty() && batch.size() < maxBatch)
+        {
+            auto first = pending.begin();
+            batch.insert(std::move(*first));
+            pending.erase(first);
+        }
+        if (!pending.empty())
+            oldest = std::chrono::steady_clock::now();
+
+        lock.unlock();
+        runBatch(batch);
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Fetch one batch of keys and fulfil their promises.
+ */
+void BatchLoader::runBatch(std::map<std::string, std::vector<std::promise<LoadResult>>> &batch)
+{
+    std::string error;
+    std::vector<std::vector<std::string>> rows;
+
+    SQLConnection *sqlPtr = pool->GetConnecion();
+    if (sqlPtr == nullptr)
+        error = "ERROR: No connection available for batch lookup.";
+    else
+    {
+        QueryBuilder query(sqlPtr);
+        query.append("SELECT ").identifier(keyColumn).append(", ").append(columns)
+            .append(" FROM ").append(table)
+            .append(" WHERE ").identifier(keyColumn).append(" IN (");
+        bool first = true;
+        for (const auto &entry : batch)
+        {
+            if (!first)
+                query.append(",");
+            query.value(entry.first);
+            first = false;
+        }
+        query.append(")");
+        rows = query.select(error);
+        pool->ReleaseConnecion(sqlPtr);
+    }
+
+    if (error.empty())
+    {
+        for (auto &row : rows)
+        {
+            if (row.empty())
+                continue;
+            auto found = batch.find(row[0]);
+            if (found == batch.end() || found->second.empty())
+                continue;
+
+            LoadResult result;
+            result.found = true;
+            result.row.assign(row.begin() + 1, row.end());
+            for (auto &promise : found->second)
+                promise.set_value(result);
+            found->second.clear();
+        }
+    }
+    else
+        std::cerr << "Batch lookup of " << batch.size() << " keys failed: " << error << std::endl;
+
+    // keys without a row, or every key if the query failed
+    for (auto &entry : batch)
+    {
+        for (auto &promise : entry.second)
+        {
+            LoadResult result;
+            result.error = error;
+            promise.set_value(std::move(result));
+        }
+    }
+}
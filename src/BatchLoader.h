@@ -0,0 +1,71 @@
+#ifndef BATCH_LOADER_H__ // #include guards
+#define BATCH_LOADER_H__
+
+/* coalesces single-row lookups by key from many threads into IN (...) queries */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include "ConnectionPool.h"
+
+struct LoadResult
+{
+    bool found = false;
+    std::vector<std::string> row; // the requested columns, key excluded
+    std::string error;
+};
+
+/**
+ * Collects keys requested by any thread for up to a short window, or until
+ * maxBatch distinct keys are waiting, then fetches them with one
+ *     SELECT key, columns FROM table WHERE key IN (...)
+ * on a single leased connection and fulfils every caller's future.
+ *
+ * Keys are matched against the key column as text, so pass them in the
+ * form the server returns them (e.g. "42", not "042").
+ */
+class BatchLoader
+{
+public:
+    BatchLoader(
+        ConnectionPool *pool, const std::string &table,
+        const std::string &keyColumn, const std::string &columns = "*",
+        unsigned int maxBatch = DEFAULT_MAX_BATCH,
+        unsigned int windowMs = DEFAULT_WINDOW_MS);
+
+    ~BatchLoader();
+
+    static const unsigned int DEFAULT_MAX_BATCH = 100;
+    static const unsigned int DEFAULT_WINDOW_MS = 2;
+
+    std::future<LoadResult> Load(const std::string &key);
+    void Stop();
+
+private:
+    void collectorLoop();
+    void runBatch(std::map<std::string, std::vector<std::promise<LoadResult>>> &batch);
+
+    ConnectionPool *pool;
+    std::string table;
+    std::string keyColumn;
+    std::string columns;
+    unsigned int maxBatch;
+    std::chrono::milliseconds window;
+
+    // guarded by mutex
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::map<std::string, std::vector<std::promise<LoadResult>>> pending;
+    std::chrono::steady_clock::time_point oldest;
+    bool running;
+
+    std::thread collectorThread;
+};
+
+#endif
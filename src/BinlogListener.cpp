@@ -0,0 +1,914 @@
+#include "BinlogListener.h"
+
+#include <iostream>
+#include <random>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+
+const unsigned int BinlogListener::HEARTBEAT_MS;
+const unsigned int BinlogListener::RECONNECT_DELAY_MS;
+
+/* binlog event types and column types used below, from the replication protocol */
+enum BinlogEventType
+{
+    QUERY_EVENT = 2,
+    ROTATE_EVENT = 4,
+    XID_EVENT = 16,
+    TABLE_MAP_EVENT = 19,
+    WRITE_ROWS_EVENT = 30,
+    UPDATE_ROWS_EVENT = 31,
+    DELETE_ROWS_EVENT = 32,
+    PARTIAL_UPDATE_ROWS_EVENT = 39
+};
+
+enum BinlogColumnType
+{
+    COLUMN_DECIMAL = 0,
+    COLUMN_TINY = 1,
+    COLUMN_SHORT = 2,
+    COLUMN_LONG = 3,
+    COLUMN_FLOAT = 4,
+    COLUMN_DOUBLE = 5,
+    COLUMN_NULL = 6,
+    COLUMN_TIMESTAMP = 7,
+    COLUMN_LONGLONG = 8,
+    COLUMN_INT24 = 9,
+    COLUMN_DATE = 10,
+    COLUMN_TIME = 11,
+    COLUMN_DATETIME = 12,
+    COLUMN_YEAR = 13,
+    COLUMN_NEWDATE = 14,
+    COLUMN_VARCHAR = 15,
+    COLUMN_BIT = 16,
+    COLUMN_TIMESTAMP2 = 17,
+    COLUMN_DATETIME2 = 18,
+    COLUMN_TIME2 = 19,
+    COLUMN_JSON = 245,
+    COLUMN_NEWDECIMAL = 246,
+    COLUMN_ENUM = 247,
+    COLUMN_SET = 248,
+    COLUMN_TINY_BLOB = 249,
+    COLUMN_MEDIUM_BLOB = 250,
+    COLUMN_LONG_BLOB = 251,
+    COLUMN_BLOB = 252,
+    COLUMN_VAR_STRING = 253,
+    COLUMN_STRING = 254,
+    COLUMN_GEOMETRY = 255
+};
+
+// TABLE_MAP optional metadata fields (binlog_row_metadata)
+enum TableMapMetadata
+{
+    METADATA_SIGNEDNESS = 1,
+    METADATA_COLUMN_NAME = 4,
+    METADATA_SIMPLE_PRIMARY_KEY = 8,
+    METADATA_PRIMARY_KEY_WITH_PREFIX = 9
+};
+
+static const size_t EVENT_HEADER_SIZE = 19;
+static const size_t CHECKSUM_SIZE = 4;
+
+static uint64_t readLittle(const unsigned char *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+static uint64_t readBig(const unsigned char *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+/**
+ * @brief Read a length-encoded integer and advance p.
+ *
+ * @returns false if it runs past end.
+ */
+static bool readPacked(const unsigned char *&p, const unsigned char *end, uint64_t &value)
+{
+    if (p >= end)
+        return false;
+    int bytes = *p < 251 ? 0 : *p == 0xfc ? 2 : *p == 0xfd ? 3 : 8;
+    if (end - p < 1 + bytes)
+        return false;
+    value = bytes == 0 ? *p : readLittle(p + 1, bytes);
+    p += 1 + bytes;
+    return true;
+}
+
+static bool bitSet(const unsigned char *bitmap, size_t i)
+{
+    return (bitmap[i / 8] >> (i % 8)) & 1;
+}
+
+static bool isNumericColumn(uint8_t type)
+{
+    return type == COLUMN_TINY || type == COLUMN_SHORT || type == COLUMN_INT24 ||
+           type == COLUMN_LONG || type == COLUMN_LONGLONG || type == COLUMN_NEWDECIMAL ||
+           type == COLUMN_FLOAT || type == COLUMN_DOUBLE;
+}
+
+// digits fraction bytes for 0..3 bytes, see DATETIME2 and TIME2
+static std::string formatFraction(uint64_t fraction, int fractionBytes, unsigned int precision)
+{
+    static const unsigned int scale[] = {1, 10000, 100, 1};
+    if (precision == 0)
+        return std::string();
+    char text[8];
+    unsigned long micros = (unsigned long)(fraction * scale[fractionBytes]);
+    for (unsigned int i = precision; i < 6; i++)
+        micros /= 10;
+    snprintf(text, sizeof(text), ".%0*lu", (int)precision, micros);
+    return text;
+}
+
+static bool decodeDecimal(uint16_t meta, const unsigned char *&p, const unsigned char *end, std::string &out)
+{
+    static const int digitBytes[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+    int precision = meta >> 8;
+    int scale = meta & 0xff;
+    if (precision == 0 || scale > precision)
+        return false;
+    int intg = precision - scale;
+    int intgFull = intg / 9, intgPart = intg % 9;
+    int fracFull = scale / 9, fracPart = scale % 9;
+    int size = intgFull * 4 + digitBytes[intgPart] + fracFull * 4 + digitBytes[fracPart];
+    if (end - p < size)
+        return false;
+
+    // sign is the inverted top bit, negative numbers have every bit inverted
+    std::vector<unsigned char> bytes(p, p + size);
+    p += size;
+    bool negative = (bytes[0] & 0x80) == 0;
+    bytes[0] ^= 0x80;
+    if (negative)
+        for (auto &b : bytes)
+            b = ~b;
+
+    const unsigned char *d = bytes.data();
+    std::string integer;
+    char group[16];
+    if (intgPart)
+    {
+        integer += std::to_string(readBig(d, digitBytes[intgPart]));
+        d += digitBytes[intgPart];
+    }
+    for (int i = 0; i < intgFull; i++, d += 4)
+    {
+        snprintf(group, sizeof(group), "%09u", (unsigned int)readBig(d, 4));
+        integer += group;
+    }
+    size_t first = integer.find_first_not_of('0');
+    integer = first == std::string::npos ? "0" : integer.substr(first);
+
+    std::string fraction;
+    for (int i = 0; i < fracFull; i++, d += 4)
+    {
+        snprintf(group, sizeof(group), "%09u", (unsigned int)readBig(d, 4));
+        fraction += group;
+    }
+    if (fracPart)
+    {
+        snprintf(group, sizeof(group), "%0*u", fracPart, (unsigned int)readBig(d, digitBytes[fracPart]));
+        fraction += group;
+    }
+
+    out = (negative ? "-" : "") + integer + (fraction.empty() ? "" : "." + fraction);
+    return true;
+}
+
+/**
+ * @brief Decode one column value of a row image into text.
+ *
+ * @returns false for types this decoder does not handle, or a truncated image.
+ */
+static bool decodeValue(uint8_t type, uint16_t meta, bool isUnsigned,
+                        const unsigned char *&p, const unsigned char *end, std::string &out)
+{
+    char text[64];
+    switch (type)
+    {
+    case COLUMN_TINY:
+    case COLUMN_SHORT:
+    case COLUMN_INT24:
+    case COLUMN_LONG:
+    case COLUMN_LONGLONG:
+    {
+        int bytes = type == COLUMN_TINY ? 1 : type == COLUMN_SHORT ? 2 : type == COLUMN_INT24 ? 3 : type == COLUMN_LONG ? 4 : 8;
+        if (end - p < bytes)
+            return false;
+        uint64_t value = readLittle(p, bytes);
+        p += bytes;
+        if (isUnsigned)
+            out = std::to_string(value);
+        else
+        {
+            // sign-extend from the column width
+            int shift = 64 - 8 * bytes;
+            out = std::to_string((long long)(value << shift) >> shift);
+        }
+        return true;
+    }
+    case COLUMN_FLOAT:
+    {
+        float value;
+        if (end - p < 4)
+            return false;
+        memcpy(&value, p, 4);
+        p += 4;
+        snprintf(text, sizeof(text), "%.9g", value);
+        out = text;
+        return true;
+    }
+    case COLUMN_DOUBLE:
+    {
+        double value;
+        if (end - p < 8)
+            return false;
+        memcpy(&value, p, 8);
+        p += 8;
+        snprintf(text, sizeof(text), "%.17g", value);
+        out = text;
+        return true;
+    }
+    case COLUMN_NEWDECIMAL:
+        return decodeDecimal(meta, p, end, out);
+    case COLUMN_YEAR:
+        if (end - p < 1)
+            return false;
+        out = *p == 0 ? "0000" : std::to_string(1900 + *p);
+        p += 1;
+        return true;
+    case COLUMN_DATE:
+    case COLUMN_NEWDATE:
+    {
+        if (end - p < 3)
+            return false;
+        uint64_t value = readLittle(p, 3);
+        p += 3;
+        snprintf(text, sizeof(text), "%04u-%02u-%02u",
+                 (unsigned int)(value >> 9), (unsigned int)((value >> 5) & 15), (unsigned int)(value & 31));
+        out = text;
+        return true;
+    }
+    case COLUMN_TIMESTAMP:
+    case COLUMN_TIMESTAMP2:
+    {
+        int fractionBytes = type == COLUMN_TIMESTAMP2 ? (meta + 1) / 2 : 0;
+        if (end - p < 4 + fractionBytes)
+            return false;
+        time_t seconds = (time_t)(type == COLUMN_TIMESTAMP2 ? readBig(p, 4) : readLittle(p, 4));
+        uint64_t fraction = readBig(p + 4, fractionBytes);
+        p += 4 + fractionBytes;
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &utc);
+        out = text + formatFraction(fraction, fractionBytes, type == COLUMN_TIMESTAMP2 ? meta : 0);
+        return true;
+    }
+    case COLUMN_DATETIME:
+    {
+        if (end - p < 8)
+            return false;
+        uint64_t value = readLittle(p, 8); // YYYYMMDDhhmmss as a number
+        p += 8;
+        snprintf(text, sizeof(text), "%04u-%02u-%02u %02u:%02u:%02u",
+                 (unsigned int)(value / 10000000000ULL), (unsigned int)(value / 100000000 % 100),
+                 (unsigned int)(value / 1000000 % 100), (unsigned int)(value / 10000 % 100),
+                 (unsigned int)(value / 100 % 100), (unsigned int)(value % 100));
+        out = text;
+        return true;
+    }
+    case COLUMN_DATETIME2:
+    {
+        int fractionBytes = (meta + 1) / 2;
+        if (end - p < 5 + fractionBytes)
+            return false;
+        int64_t value = (int64_t)readBig(p, 5) - 0x8000000000LL;
+        uint64_t fraction = readBig(p + 5, fractionBytes);
+        p += 5 + fractionBytes;
+        uint64_t ymd = (uint64_t)value >> 17, hms = (uint64_t)value & 0x1ffff;
+        uint64_t ym = ymd >> 5;
+        snprintf(text, sizeof(text), "%04u-%02u-%02u %02u:%02u:%02u",
+                 (unsigned int)(ym / 13), (unsigned int)(ym % 13), (unsigned int)(ymd & 31),
+                 (unsigned int)(hms >> 12), (unsigned int)((hms >> 6) & 63), (unsigned int)(hms & 63));
+        out = text + formatFraction(fraction, fractionBytes, meta);
+        return true;
+    }
+    case COLUMN_TIME:
+    {
+        if (end - p < 3)
+            return false;
+        uint64_t value = readLittle(p, 3); // HHMMSS as a number
+        p += 3;
+        snprintf(text, sizeof(text), "%02u:%02u:%02u",
+                 (unsigned int)(value / 10000), (unsigned int)(value / 100 % 100), (unsigned int)(value % 100));
+        out = text;
+        return true;
+    }
+    case COLUMN_TIME2:
+    {
+        // the integer and fractional parts form one offset big-endian number
+        int fractionBytes = (meta + 1) / 2;
+        if (end - p < 3 + fractionBytes)
+            return false;
+        int64_t packed = (int64_t)readBig(p, 3 + fractionBytes) - (0x800000LL << (8 * fractionBytes));
+        p += 3 + fractionBytes;
+        bool negative = packed < 0;
+        uint64_t magnitude = negative ? -packed : packed;
+        uint64_t hms = magnitude >> (8 * fractionBytes);
+        uint64_t fraction = magnitude & ((1ULL << (8 * fractionBytes)) - 1);
+        snprintf(text, sizeof(text), "%s%02u:%02u:%02u", negative ? "-" : "",
+                 (unsigned int)((hms >> 12) & 0x3ff), (unsigned int)((hms >> 6) & 63), (unsigned int)(hms & 63));
+        out = text + formatFraction(fraction, fractionBytes, meta);
+        return true;
+    }
+    case COLUMN_BIT:
+    {
+        int bytes = (meta >> 8) + ((meta & 0xff) + 7) / 8;
+        if (end - p < bytes || bytes > 8)
+            return false;
+        out = std::to_string(readBig(p, bytes));
+        p += bytes;
+        return true;
+    }
+    case COLUMN_VARCHAR:
+    case COLUMN_VAR_STRING:
+    {
+        int prefix = meta < 256 ? 1 : 2;
+        if (end - p < prefix)
+            return false;
+        uint64_t length = readLittle(p, prefix);
+        p += prefix;
+        if ((uint64_t)(end - p) < length)
+            return false;
+        out.assign((const char *)p, length);
+        p += length;
+        return true;
+    }
+    case COLUMN_STRING:
+    {
+        // CHAR, ENUM and SET share this type; the real type and length are
+        // packed into the metadata
+        unsigned int realType = meta >> 8;
+        unsigned int maxLength = meta & 0xff;
+        if ((realType & 0x30) != 0x30)
+        {
+            maxLength += ((realType & 0x30) ^ 0x30) << 4;
+            realType |= 0x30;
+        }
+        if (realType == COLUMN_ENUM || realType == COLUMN_SET)
+        {
+            if (end - p < (long)maxLength || maxLength > 8)
+                return false;
+            out = std::to_string(readLittle(p, maxLength)); // index or bitmask
+            p += maxLength;
+            return true;
+        }
+        int prefix = maxLength < 256 ? 1 : 2;
+        if (end - p < prefix)
+            return false;
+        uint64_t length = readLittle(p, prefix);
+        p += prefix;
+        if ((uint64_t)(end - p) < length)
+            return false;
+        out.assign((const char *)p, length);
+        p += length;
+        return true;
+    }
+    case COLUMN_TINY_BLOB:
+    case COLUMN_MEDIUM_BLOB:
+    case COLUMN_LONG_BLOB:
+    case COLUMN_BLOB:
+    case COLUMN_JSON:
+    case COLUMN_GEOMETRY:
+    {
+        // JSON and GEOMETRY are passed on in their binary storage format
+        int prefix = meta;
+        if (prefix < 1 || prefix > 4 || end - p < prefix)
+            return false;
+        uint64_t length = readLittle(p, prefix);
+        p += prefix;
+        if ((uint64_t)(end - p) < length)
+            return false;
+        out.assign((const char *)p, length);
+        p += length;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Construct a new Binlog Listener:: Binlog Listener object
+ *
+ * @param options server and credentials of the dedicated connection.
+ * @param serverId replica id to register with, unique among the server's
+ * replicas; 0 picks a random one.
+ */
+BinlogListener::BinlogListener(const PoolOptions &options, unsigned int serverId)
+{
+    this->options = options;
+    this->serverId = serverId;
+    if (this->serverId == 0)
+    {
+        std::mt19937 engine(std::random_device{}());
+        this->serverId = std::uniform_int_distribution<unsigned int>(1u << 30, 0x7fffffffu)(engine);
+    }
+    this->checksum = false;
+    this->position = 0;
+    this->running = false;
+    memset(&rpl, 0, sizeof(rpl));
+}
+
+BinlogListener::~BinlogListener()
+{
+    Stop();
+}
+
+/**
+ * @brief Add a handler for change events, called from the reader thread.
+ *
+ * Handlers must be added before Start.
+ */
+void BinlogListener::Subscribe(ChangeHandler handler)
+{
+    handlers.push_back(handler);
+}
+
+/**
+ * @brief Start following the binlog from the server's current position.
+ */
+bool BinlogListener::Start(std::string &error)
+{
+    SQLConnection status(options);
+    if (!status.connect())
+    {
+        error = "ERROR: Cannot connect to read the binlog position.";
+        return false;
+    }
+    // SHOW MASTER STATUS was renamed in 8.2 and removed in 8.4
+    auto rows = status.selectQuery("SHOW BINARY LOG STATUS", error);
+    if (!error.empty())
+    {
+        error.clear();
+        rows = status.selectQuery("SHOW MASTER STATUS", error);
+    }
+    status.close();
+    if (!error.empty())
+        return false;
+    if (rows.empty() || rows[0].size() < 2)
+    {
+        error = "ERROR: Binary logging is not enabled on the server.";
+        return false;
+    }
+    return Start(rows[0][0], std::stoull(rows[0][1]), error);
+}
+
+/**
+ * @brief Start following the binlog from a saved position, e.g. one read
+ * with Position() before a restart.
+ */
+bool BinlogListener::Start(const std::string &file, uint64_t position, std::string &error)
+{
+    if (running)
+        return true;
+    {
+        std::lock_guard<std::mutex> lock(positionMutex);
+        this->file = file;
+        this->position = position < 4 ? 4 : position;
+    }
+    if (!open(error))
+        return false;
+
+    running = true;
+    readThread = std::thread(&BinlogListener::readLoop, this);
+    return true;
+}
+
+void BinlogListener::Stop()
+{
+    running = false;
+    if (readThread.joinable())
+        readThread.join();
+}
+
+/**
+ * @brief Position after the last complete transaction, to resume from.
+ */
+void BinlogListener::Position(std::string &file, uint64_t &position)
+{
+    std::lock_guard<std::mutex> lock(positionMutex);
+    file = this->file;
+    position = this->position;
+}
+
+/**
+ * @brief Connect and register as a replica at the saved position.
+ */
+bool BinlogListener::open(std::string &error)
+{
+    connection.reset(new SQLConnection(options));
+    if (!connection->connect())
+    {
+        error = "ERROR: Cannot connect for binlog streaming.";
+        return false;
+    }
+
+    // the server only streams checksummed events to replicas that say they
+    // understand them
+    auto algorithm = connection->infoQuery("SELECT @@global.binlog_checksum", error);
+    if (!error.empty())
+        return false;
+    checksum = !algorithm.empty() && algorithm[0] != "NONE";
+    // heartbeats wake the reader regularly so Stop does not wait for a write
+    std::string heartbeat = std::to_string((unsigned long long)HEARTBEAT_MS * 1000000);
+    std::string setupError;
+    if (!connection->checkQuery("SET @master_binlog_checksum = @@global.binlog_checksum", setupError) ||
+        !connection->checkQuery("SET @master_heartbeat_period = " + heartbeat, setupError))
+    {
+        error = "ERROR: Cannot set up the binlog session: " +
+                (setupError.empty() ? std::string("unknown error") : setupError);
+        return false;
+    }
+
+    tables.clear();
+    std::string startFile;
+    {
+        std::lock_guard<std::mutex> lock(positionMutex);
+        startFile = file;
+        rpl.start_position = position;
+    }
+    rpl.file_name_length = startFile.size();
+    rpl.file_name = startFile.c_str();
+    rpl.server_id = serverId;
+    rpl.flags = 0;
+    rpl.gtid_set_encoded_size = 0;
+    rpl.fix_gtid_set = nullptr;
+    rpl.gtid_set_arg = nullptr;
+    if (mysql_binlog_open(connection->getHandle(), &rpl) != 0)
+    {
+        error = mysql_error(connection->getHandle());
+        return false;
+    }
+    rpl.file_name = nullptr;
+    return true;
+}
+
+void BinlogListener::close()
+{
+    if (connection && connection->getHandle())
+        mysql_binlog_close(connection->getHandle(), &rpl);
+    connection.reset();
+}
+
+void BinlogListener::readLoop()
+{
+    while (running)
+    {
+        if (mysql_binlog_fetch(connection->getHandle(), &rpl) == 0 && rpl.size > 0)
+        {
+            // skip the OK byte in front of every event packet
+            if (handleEvent(rpl.buffer + 1, rpl.size - 1))
+                continue;
+        }
+        if (!running)
+            break;
+
+        std::cerr << "Binlog stream interrupted: " << mysql_error(connection->getHandle())
+                  << ", reconnecting." << std::endl;
+        close();
+        while (running)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_DELAY_MS));
+            std::string error;
+            if (open(error))
+                break;
+            std::cerr << "Binlog reconnect failed: " << error << std::endl;
+        }
+    }
+    close();
+}
+
+/**
+ * @brief Dispatch one event.
+ *
+ * @returns false if the event is malformed.
+ */
+bool BinlogListener::handleEvent(const unsigned char *event, size_t size)
+{
+    if (size < EVENT_HEADER_SIZE)
+        return false;
+    uint8_t type = event[4];
+    uint64_t eventSize = readLittle(event + 9, 4);
+    uint64_t logPosition = readLittle(event + 13, 4);
+    if (eventSize > size)
+        return false;
+
+    const unsigned char *data = event + EVENT_HEADER_SIZE;
+    const unsigned char *end = event + eventSize;
+    if (checksum && end - data >= (long)CHECKSUM_SIZE)
+        end -= CHECKSUM_SIZE;
+
+    switch (type)
+    {
+    case ROTATE_EVENT:
+        if (end - data >= 8)
+        {
+            std::lock_guard<std::mutex> lock(positionMutex);
+            position = readLittle(data, 8);
+            file.assign((const char *)data + 8, end - data - 8);
+        }
+        break;
+    case TABLE_MAP_EVENT:
+        handleTableMap(data, end);
+        break;
+    case WRITE_ROWS_EVENT:
+    case UPDATE_ROWS_EVENT:
+    case DELETE_ROWS_EVENT:
+    case PARTIAL_UPDATE_ROWS_EVENT:
+        handleRows(type, data, end);
+        break;
+    case QUERY_EVENT:
+        handleQuery(data, end);
+        break;
+    default:
+        break;
+    }
+
+    // only transaction boundaries are safe points to resume from
+    if ((type == XID_EVENT || type == QUERY_EVENT) && logPosition > 0)
+    {
+        std::lock_guard<std::mutex> lock(positionMutex);
+        position = logPosition;
+    }
+    return true;
+}
+
+void BinlogListener::handleTableMap(const unsigned char *data, const unsigned char *end)
+{
+    const unsigned char *p = data;
+    if (end - p < 9)
+        return;
+    uint64_t tableId = readLittle(p, 6);
+    p += 8;
+
+    TableMap map;
+    size_t length = *p++;
+    if ((size_t)(end - p) < length + 2)
+        return;
+    map.database.assign((const char *)p, length);
+    p += length + 1;
+    length = *p++;
+    if ((size_t)(end - p) < length + 1)
+        return;
+    map.table.assign((const char *)p, length);
+    p += length + 1;
+
+    uint64_t columns;
+    if (!readPacked(p, end, columns) || (uint64_t)(end - p) < columns)
+        return;
+    map.types.assign(p, p + columns);
+    p += columns;
+
+    uint64_t metaLength;
+    if (!readPacked(p, end, metaLength) || (uint64_t)(end - p) < metaLength)
+        return;
+    const unsigned char *meta = p;
+    const unsigned char *metaEnd = p + metaLength;
+    map.meta.resize(columns, 0);
+    for (size_t i = 0; i < columns; i++)
+    {
+        switch (map.types[i])
+        {
+        case COLUMN_FLOAT:
+        case COLUMN_DOUBLE:
+        case COLUMN_TIMESTAMP2:
+        case COLUMN_DATETIME2:
+        case COLUMN_TIME2:
+        case COLUMN_TINY_BLOB:
+        case COLUMN_MEDIUM_BLOB:
+        case COLUMN_LONG_BLOB:
+        case COLUMN_BLOB:
+        case COLUMN_JSON:
+        case COLUMN_GEOMETRY:
+            if (meta + 1 > metaEnd)
+                return;
+            map.meta[i] = *meta;
+            meta += 1;
+            break;
+        case COLUMN_VARCHAR:
+        case COLUMN_VAR_STRING:
+        case COLUMN_BIT:
+            if (meta + 2 > metaEnd)
+                return;
+            map.meta[i] = (uint16_t)readLittle(meta, 2);
+            meta += 2;
+            break;
+        case COLUMN_NEWDECIMAL:
+        case COLUMN_STRING:
+        case COLUMN_ENUM:
+        case COLUMN_SET:
+            if (meta + 2 > metaEnd)
+                return;
+            map.meta[i] = (uint16_t)readBig(meta, 2);
+            meta += 2;
+            break;
+        default:
+            break;
+        }
+    }
+    p = metaEnd;
+    p += (columns + 7) / 8; // nullability bitmap
+
+    // optional metadata, only present with binlog_row_metadata set
+    map.isUnsigned.assign(columns, false);
+    while (p < end)
+    {
+        uint8_t field = *p++;
+        uint64_t fieldLength;
+        if (!readPacked(p, end, fieldLength) || (uint64_t)(end - p) < fieldLength)
+            break;
+        const unsigned char *value = p;
+        const unsigned char *valueEnd = p + fieldLength;
+        p = valueEnd;
+
+        if (field == METADATA_SIGNEDNESS)
+        {
+            size_t numeric = 0;
+            for (size_t i = 0; i < columns; i++)
+            {
+                if (!isNumericColumn(map.types[i]))
+                    continue;
+                if (value + numeric / 8 < valueEnd)
+                    map.isUnsigned[i] = (value[numeric / 8] >> (7 - numeric % 8)) & 1;
+                numeric++;
+            }
+        }
+        else if (field == METADATA_COLUMN_NAME)
+        {
+            while (value < valueEnd)
+            {
+                uint64_t nameLength;
+                if (!readPacked(value, valueEnd, nameLength) || (uint64_t)(valueEnd - value) < nameLength)
+                    break;
+                map.names.emplace_back((const char *)value, nameLength);
+                value += nameLength;
+            }
+        }
+        else if (field == METADATA_SIMPLE_PRIMARY_KEY || field == METADATA_PRIMARY_KEY_WITH_PREFIX)
+        {
+            while (value < valueEnd)
+            {
+                uint64_t index, prefix;
+                if (!readPacked(value, valueEnd, index) || index >= columns)
+                    break;
+                if (field == METADATA_PRIMARY_KEY_WITH_PREFIX && !readPacked(value, valueEnd, prefix))
+                    break;
+                map.primaryKey.push_back((int)index);
+            }
+        }
+    }
+
+    tables[tableId] = std::move(map);
+}
+
+void BinlogListener::handleRows(uint8_t type, const unsigned char *data, const unsigned char *end)
+{
+    const unsigned char *p = data;
+    if (end - p < 10)
+        return;
+    uint64_t tableId = readLittle(p, 6);
+    uint64_t extraLength = readLittle(p + 8, 2);
+    p += 8 + (extraLength >= 2 ? extraLength : 2);
+
+    auto found = tables.find(tableId);
+    if (found == tables.end())
+        return;
+    const TableMap &map = found->second;
+
+    ChangeEvent change;
+    change.database = map.database;
+    change.table = map.table;
+    change.columns = map.names;
+    change.kind = type == WRITE_ROWS_EVENT ? ChangeEvent::ROW_INSERT
+                : type == DELETE_ROWS_EVENT ? ChangeEvent::ROW_DELETE
+                : ChangeEvent::ROW_UPDATE;
+    {
+        std::lock_guard<std::mutex> lock(positionMutex);
+        change.file = file;
+        change.position = position;
+    }
+
+    uint64_t columns = 0;
+    bool decoded = type != PARTIAL_UPDATE_ROWS_EVENT && readPacked(p, end, columns) && columns == map.types.size();
+    size_t bitmapSize = decoded ? (columns + 7) / 8 : 0;
+    const unsigned char *present = p;
+    const unsigned char *presentAfter = p;
+    bool twoImages = type == UPDATE_ROWS_EVENT;
+    if (decoded && (size_t)(end - p) < bitmapSize * (twoImages ? 2 : 1))
+        decoded = false;
+    if (decoded)
+    {
+        p += bitmapSize;
+        if (twoImages)
+        {
+            presentAfter = p;
+            p += bitmapSize;
+        }
+    }
+
+    auto readImage = [&](const unsigned char *bitmap, std::vector<std::string> &image) {
+        size_t count = 0;
+        for (size_t i = 0; i < columns; i++)
+            count += bitSet(bitmap, i);
+        size_t nullSize = (count + 7) / 8;
+        if ((size_t)(end - p) < nullSize)
+            return false;
+        const unsigned char *nulls = p;
+        p += nullSize;
+
+        image.assign(columns, std::string());
+        size_t ordinal = 0;
+        for (size_t i = 0; i < columns; i++)
+        {
+            if (!bitSet(bitmap, i))
+                continue; // column not logged (binlog_row_image=MINIMAL)
+            if (bitSet(nulls, ordinal++))
+                image[i] = "NULL";
+            else if (!decodeValue(map.types[i], map.meta[i], map.isUnsigned[i], p, end, image[i]))
+                return false;
+        }
+        return true;
+    };
+
+    while (decoded && p < end)
+    {
+        change.before.clear();
+        change.after.clear();
+        change.key.clear();
+        if (change.kind != ChangeEvent::ROW_INSERT && !readImage(present, change.before))
+            decoded = false;
+        else if (change.kind != ChangeEvent::ROW_DELETE && !readImage(presentAfter, change.after))
+            decoded = false;
+        else
+        {
+            const std::vector<std::string> &image = change.kind == ChangeEvent::ROW_DELETE ? change.before : change.after;
+            for (int index : map.primaryKey)
+                change.key.push_back(image[index]);
+            publish(change);
+        }
+    }
+
+    if (!decoded)
+    {
+        ChangeEvent tableChange;
+        tableChange.kind = ChangeEvent::TABLE_CHANGED;
+        tableChange.database = map.database;
+        tableChange.table = map.table;
+        tableChange.file = change.file;
+        tableChange.position = change.position;
+        publish(tableChange);
+    }
+}
+
+void BinlogListener::handleQuery(const unsigned char *data, const unsigned char *end)
+{
+    // post header: thread id, exec time, schema length, error code, status vars length
+    if (end - data < 13)
+        return;
+    size_t schemaLength = data[8];
+    size_t statusLength = readLittle(data + 11, 2);
+    const unsigned char *p = data + 13 + statusLength;
+    if ((size_t)(end - p) < schemaLength + 1)
+        return;
+
+    ChangeEvent change;
+    change.kind = ChangeEvent::TABLE_CHANGED;
+    change.database.assign((const char *)p, schemaLength);
+    p += schemaLength + 1;
+    change.statement.assign((const char *)p, end - p);
+
+    // row changes arrive as row events, the statements around them only mark transactions
+    if (change.statement == "BEGIN" || change.statement == "COMMIT" || change.statement == "ROLLBACK")
+        return;
+    {
+        std::lock_guard<std::mutex> lock(positionMutex);
+        change.file = file;
+        change.position = position;
+    }
+    publish(change);
+}
+
+void BinlogListener::publish(const ChangeEvent &change)
+{
+    for (auto &handler : handlers)
+        handler(change);
+}
@@ -0,0 +1,114 @@
+#ifndef BINLOG_LISTENER_H__ // #include guards
+#define BINLOG_LISTENER_H__
+
+/* follows the server's binary log and reports row changes as they commit */
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+#include "SQLConnection.h"
+
+struct ChangeEvent
+{
+    enum Kind
+    {
+        ROW_INSERT,
+        ROW_UPDATE,
+        ROW_DELETE,
+        TABLE_CHANGED // rows could not be decoded, or a statement such as DDL or TRUNCATE
+    };
+
+    Kind kind;
+    std::string database;
+    std::string table;     // empty for statements, whose table is not parsed
+    std::string statement; // set for statements only
+
+    // row images as text, SQL NULL as "NULL"; before is empty for inserts,
+    // after is empty for deletes
+    std::vector<std::string> before;
+    std::vector<std::string> after;
+
+    // names and primary key values, when the server logs them
+    // (binlog_row_metadata=FULL)
+    std::vector<std::string> columns;
+    std::vector<std::string> key;
+
+    std::string file; // binlog position after this event
+    uint64_t position;
+};
+
+typedef std::function<void(const ChangeEvent &)> ChangeHandler;
+
+/**
+ * Row-based replication client on a dedicated connection.
+ *
+ * Registers as a replica with its own server id, reads events with
+ * mysql_binlog_open/mysql_binlog_fetch and decodes TABLE_MAP and the v2
+ * WRITE/UPDATE/DELETE_ROWS events for the common column types. Rows with
+ * a column it cannot decode are reported as TABLE_CHANGED for their table,
+ * so a cache can still drop everything it holds for it.
+ *
+ * The server needs binlog_format=ROW, and the user the REPLICATION SLAVE
+ * (REPLICATION REPLICA) and REPLICATION CLIENT privileges.
+ */
+class BinlogListener
+{
+public:
+    BinlogListener(const PoolOptions &options, unsigned int serverId = 0);
+    ~BinlogListener();
+
+    static const unsigned int HEARTBEAT_MS = 500;
+    static const unsigned int RECONNECT_DELAY_MS = 1000;
+
+    void Subscribe(ChangeHandler handler);
+    bool Start(std::string &error);
+    bool Start(const std::string &file, uint64_t position, std::string &error);
+    void Stop();
+    void Position(std::string &file, uint64_t &position);
+
+private:
+    struct TableMap
+    {
+        std::string database;
+        std::string table;
+        std::vector<uint8_t> types;
+        std::vector<uint16_t> meta;
+        std::vector<bool> isUnsigned;
+        std::vector<std::string> names;
+        std::vector<int> primaryKey;
+    };
+
+    bool open(std::string &error);
+    void close();
+    void readLoop();
+    bool handleEvent(const unsigned char *event, size_t size);
+    void handleTableMap(const unsigned char *data, const unsigned char *end);
+    void handleRows(uint8_t type, const unsigned char *data, const unsigned char *end);
+    void handleQuery(const unsigned char *data, const unsigned char *end);
+    void publish(const ChangeEvent &change);
+
+    PoolOptions options;
+    unsigned int serverId;
+    std::unique_ptr<SQLConnection> connection;
+    bool checksum;
+    MYSQL_RPL rpl;
+
+    std::vector<ChangeHandler> handlers;
+    std::unordered_map<uint64_t, TableMap> tables;
+
+    std::mutex positionMutex; // guards file and position
+    std::string file;
+    uint64_t position;
+
+    std::atomic<bool> running;
+    std::thread readThread;
+};
+
+#endif
@@ -0,0 +1,1428 @@
+#include "ConnectionPool.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <sched.h>
+
+#ifdef MYSQLPOOL_HAVE_NUMA
+#include <numa.h>
+#endif
+
+const unsigned int ConnectionPool::DRAIN_TIMEOUT_SECONDS;
+const unsigned int ConnectionPool::MAINTENANCE_INTERVAL_MS;
+const unsigned int ConnectionPool::LIFETIME_JITTER_PERCENT;
+const unsigned int ConnectionPool::PARTITION_IDLE_MS;
+const unsigned int ConnectionPool::PARTITION_WAIT_MS;
+const unsigned int ConnectionPool::RECONNECT_BACKOFF_MAX_MS;
+
+/**
+ * @brief Construct a new Connection Pool:: Connection Pool object
+ *
+ * @param server mysql server name or ip address.
+ * @param port mysql server port.
+ * @param user mysql user name.
+ * @param password mysql user password.
+ * @param database mysql database name.
+ * @param numConnection number of connection to create.
+ * @param initializer optional hook run on each connection before it joins the pool.
+ *
+ * @returns ConnectionPool object that got created.
+ */
+ConnectionPool::ConnectionPool(std::string server, int port, std::string user, std::string password, std::string database, int numConnection, ConnectionInitializer initializer)
+    : ConnectionPool(MakeOptions(server, port, user, password, database, numConnection), initializer)
+{
+}
+
+/**
+ * @brief Construct a new Connection Pool:: Connection Pool object
+ *
+ * @param options server, credentials, sizing and connection settings.
+ * @param initializer optional hook run on each connection before it joins the pool.
+ *
+ * @returns ConnectionPool object that got created.
+ */
+ConnectionPool::ConnectionPool(const PoolOptions &options, ConnectionInitializer initializer)
+{
+    if (options.server.empty() || options.user.empty())
+    {
+        throw std::invalid_argument("Server or user name is empty.");
+    }
+
+    if (options.verbose)
+        std::cout << "Creating connection pool server=" << options.server << " database=" << options.database << std::endl;
+
+    _pool_mutex.clear();
+    hasActiveConnections = false;
+    draining = false;
+    maintenanceRunning = false;
+    this->options = options;
+    this->initializer = initializer;
+    retryBudget = std::make_shared<RetryBudget>(options.retryBudgetRatio, options.retryBudgetMinPerSecond);
+    jitterEngine.seed(std::random_device()());
+
+    slotCapacity = std::max(options.numConnection, options.maxConnections);
+    targetSize = options.numConnection;
+    acquireTimeout = options.acquireTimeout;
+    maxLease = options.maxLease;
+    generation = 0;
+    leasedCount = 0;
+    slotState.reset(new std::atomic<int>[slotCapacity]);
+    slotGeneration.reset(new std::atomic<unsigned int>[slotCapacity]);
+    slotExpiry.reset(new std::atomic<long long>[slotCapacity]);
+    slotLeasedAt.reset(new std::atomic<long long>[slotCapacity]);
+    slotLeaseSeq.reset(new std::atomic<unsigned long long>[slotCapacity]);
+    slotHolder.reset(new std::atomic<SQLConnection *>[slotCapacity]);
+    // a slot always returns to the same shard, ind % shardCount
+    shardCount = options.shards < 0 ? (int)std::thread::hardware_concurrency() : options.shards;
+    shardCount = std::max(1, std::min(shardCount, options.numConnection));
+    if (options.numaAware)
+        setupNumaShards();
+    for (int i = 0; i < shardCount; i++)
+        freeLists.emplace_back(new SlotFreeList(slotCapacity));
+    for (int i = 0; i < shardCount; i++)
+        leaseStats.emplace_back(new LeaseStats());
+    sizingStart = std::chrono::steady_clock::now();
+    retireList.reset(new SlotFreeList(slotCapacity));
+    mySqlPtrList.resize(slotCapacity);
+    slotFailures.assign(slotCapacity, 0);
+    slotRetryAt.reset(new std::atomic<long long>[slotCapacity]);
+    backoffGeneration = 0;
+    slotPartition.reset(new std::atomic<int>[slotCapacity]);
+    for (size_t i = 0; i < slotCapacity; i++)
+    {
+        slotState[i] = SLOT_EMPTY;
+        slotGeneration[i] = 0;
+        slotExpiry[i] = 0;
+        slotRetryAt[i] = 0;
+        slotLeasedAt[i] = 0;
+        slotLeaseSeq[i] = 0;
+        slotHolder[i] = nullptr;
+        slotPartition[i] = 0;
+    }
+    if (!options.partitions.empty())
+        setupPartitions(options.partitions);
+
+    bool success = false;
+    try
+    {
+        for (int i = 0; i < options.numConnection; i++)
+        {
+            slotState[i] = SLOT_BUSY;
+            lockPool();
+            setExpiry(i);
+            unlockPool();
+
+            runOnHomeNode(i, [&]() {
+                mySqlPtrList[i].reset(new SQLConnection(options, i, retryBudget));
+                success = mySqlPtrList[i]->connect();
+                if (success)
+                    initializeConnection(mySqlPtrList[i].get());
+            });
+
+            if (success)
+            {
+                slotState[i] = SLOT_IDLE;
+                pushIdle(i);
+            }
+            else
+            {
+                std::cerr << "Connection pool failed. Cannot connect to server." << std::endl;
+                ClosePoolConnections();
+                throw std::runtime_error("Failed to connect to server.");
+            }
+        }
+
+        size_t count = options.numConnection;
+        if (success && count > 0 && count == idleCount())
+        {
+            hasActiveConnections = true;
+            if (options.verbose)
+                std::cout << "Pool created successfully." << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        ClosePoolConnections();
+        std::cerr << "Exception caught while creating connection pool: " << e.what() << std::endl;
+        throw; // rethrow the exception to be handled by the caller
+    }
+
+    maintenanceRunning = true;
+    maintenanceThread = std::thread(&ConnectionPool::maintenanceLoop, this);
+}
+
+/**
+ * @brief Destroy the Connection Pool:: Connection Pool object
+ *
+ * Drains the pool first so that no connection is closed while a caller is
+ * still running a query on it.
+ */
+ConnectionPool::~ConnectionPool()
+{
+    if (!draining)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(DRAIN_TIMEOUT_SECONDS);
+        if (!Drain(deadline))
+            std::cerr << "Destroying connection pool with connections still in use." << std::endl;
+    }
+    stopMaintenance();
+}
+
+void ConnectionPool::lockPool()
+{
+    while (_pool_mutex.test_and_set(std::memory_order_acquire))
+        std::this_thread::yield();
+}
+
+void ConnectionPool::unlockPool()
+{
+    _pool_mutex.clear(std::memory_order_release);
+}
+
+bool ConnectionPool::HasActiveConnections()
+{
+    return hasActiveConnections;
+}
+
+/**
+ * @brief Retry budget shared by the pool's connections, e.g. to let other
+ * retrying code, such as a HedgedReader, draw from it too.
+ */
+std::shared_ptr<RetryBudget> ConnectionPool::GetRetryBudget()
+{
+    return retryBudget;
+}
+
+SQLConnection *ConnectionPool::GetConnecion(unsigned int timeout)
+{
+    return acquire(0, timeout);
+}
+
+/**
+ * @brief Lease an idle connection without waiting for one.
+ *
+ * @returns the connection, or nullptr if none is idle right now.
+ */
+SQLConnection *ConnectionPool::TryGetConnecion()
+{
+    return acquire(0, 0, false);
+}
+
+/**
+ * @brief Lease a connection on behalf of one partition of the pool.
+ *
+ * The partition gets a connection while it holds fewer than its reserved
+ * minimum, or, below its maximum, when enough connections remain for the
+ * reservations of the partitions that are in use. A reservation is lent
+ * to other partitions once its partition has leased nothing for
+ * PARTITION_IDLE_MS.
+ *
+ * @param partition name of a partition from options.partitions.
+ * @param timeout seconds to wait, 0 for the pool's acquire timeout.
+ *
+ * @returns the connection, or nullptr for an unknown partition or on timeout.
+ */
+SQLConnection *ConnectionPool::GetConnecion(const std::string &partition, unsigned int timeout)
+{
+    for (size_t i = 1; i < partitions.size(); i++)
+    {
+        if (partitions[i]->name == partition)
+            return acquire((int)i, timeout);
+    }
+    std::cerr << "Unknown pool partition " << partition << "." << std::endl;
+    return nullptr;
+}
+
+SQLConnection *ConnectionPool::acquire(int partition, unsigned int timeout, bool wait)
+{
+    if (!hasActiveConnections)
+    {
+        std::cerr << "No active sql connection." << std::endl;
+        return nullptr;
+    }
+
+    if (timeout < 0)
+        std::cerr << "Error: Get connection Timeout value less then 0." << std::endl;
+
+    if (timeout == 0)
+        timeout = acquireTimeout.load(std::memory_order_relaxed);
+
+    int ind;
+    bool success = false;
+    auto begin = std::chrono::steady_clock::now();
+
+    do
+    {
+        if (draining)
+        {
+            std::cerr << "Connection pool is draining." << std::endl;
+            return nullptr;
+        }
+
+        bool admitted = partitions.empty() || admitPartition(partition);
+        success = admitted && popIdle(ind);
+        if (success)
+        {
+            // read the connection before the lease is published, a revocation
+            // may move it out of the slot right after
+            SQLConnection *sqlPtr = mySqlPtrList[ind].get();
+            auto now = std::chrono::steady_clock::now();
+            leaseStats[ind % shardCount]->RecordAcquire(std::chrono::duration_cast<std::chrono::nanoseconds>(now - begin).count());
+            slotPartition[ind].store(partition, std::memory_order_relaxed);
+            slotLeasedAt[ind].store(now.time_since_epoch().count(), std::memory_order_relaxed);
+            slotLeaseSeq[ind].fetch_add(1, std::memory_order_release);
+            slotHolder[ind].store(sqlPtr, std::memory_order_release);
+            slotState[ind].store(SLOT_LEASED, std::memory_order_release);
+            leasedCount.fetch_add(1, std::memory_order_relaxed);
+            return sqlPtr;
+        }
+        if (admitted && !partitions.empty())
+        {
+            partitions[partition]->leased.fetch_sub(1, std::memory_order_relaxed);
+            partitionReleased.notify_all();
+        }
+        if (!wait)
+            return nullptr;
+
+        // sleep until a lease comes back instead of retaking partitionMutex
+        // in a loop; timed, as a lost wakeup or a reservation lapsing after
+        // PARTITION_IDLE_MS does not notify
+        if (!partitions.empty())
+        {
+            std::unique_lock<std::mutex> lock(partitionMutex);
+            partitionReleased.wait_for(lock, std::chrono::milliseconds(PARTITION_WAIT_MS));
+        }
+
+        // set max waiting time to get connection
+        // return nullptr on time out
+        if (timeout > 0)
+        {
+            auto end = std::chrono::steady_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(end - begin).count();
+            if (elapsed >= timeout)
+            {
+                leaseStats[localShard()]->RecordTimeout();
+                return nullptr;
+            }
+        }
+
+    } while (!success);
+
+    return nullptr;
+}
+
+bool ConnectionPool::ReleaseConnecion(SQLConnection *sqlPtr)
+{
+    int ind = sqlPtr->getPoolId();
+    if (ind > -1 && ind < (int)slotCapacity)
+    {
+        SQLConnection *expected = sqlPtr;
+        // already released, or revoked and waiting in revokedList
+        if (!slotHolder[ind].compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel) &&
+            !releaseRevoked(sqlPtr))
+            return true;
+        slotState[ind].store(SLOT_BUSY, std::memory_order_relaxed);
+        leasedCount.fetch_sub(1, std::memory_order_relaxed);
+        if (!partitions.empty())
+        {
+            partitions[slotPartition[ind].load(std::memory_order_relaxed)]->leased.fetch_sub(1, std::memory_order_relaxed);
+            partitionReleased.notify_all();
+        }
+        std::chrono::steady_clock::duration held(
+            std::chrono::steady_clock::now().time_since_epoch().count() - slotLeasedAt[ind].load(std::memory_order_relaxed));
+        leaseStats[ind % shardCount]->RecordRelease(std::chrono::duration_cast<std::chrono::nanoseconds>(held).count());
+
+        if (draining)
+        {
+            // the pool is shutting down, the connection is not handed out again
+            sqlPtr->close();
+            slotState[ind].store(SLOT_CLOSED);
+            return true;
+        }
+
+        // outdated connections are swapped by the maintenance thread, unless
+        // the last swap failed and the slot waits for its next attempt
+        if (isStale(ind) && !inBackoff(ind))
+        {
+            retireList->push(ind);
+            return true;
+        }
+
+        slotState[ind].store(SLOT_IDLE, std::memory_order_relaxed);
+        pushIdle(ind);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Leases and limits of each partition, the unnamed one first.
+ */
+std::vector<PartitionStats> ConnectionPool::GetPartitionStats()
+{
+    std::vector<PartitionStats> result;
+    for (auto &partition : partitions)
+    {
+        PartitionStats stats;
+        stats.name = partition->name;
+        stats.minConnections = partition->minConnections;
+        stats.maxConnections = partition->maxConnections;
+        stats.leased = partition->leased.load(std::memory_order_relaxed);
+        result.push_back(stats);
+    }
+    return result;
+}
+
+void ConnectionPool::setupPartitions(const std::vector<PoolPartition> &configured)
+{
+    int reserved = 0;
+    partitions.emplace_back(new Partition());
+    for (const PoolPartition &entry : configured)
+    {
+        if (entry.name.empty() || entry.minConnections < 0 || entry.maxConnections < 0 ||
+            (entry.maxConnections > 0 && entry.maxConnections < entry.minConnections))
+            throw std::invalid_argument("Invalid pool partition " + entry.name + ".");
+        for (auto &partition : partitions)
+        {
+            if (partition->name == entry.name)
+                throw std::invalid_argument("Duplicate pool partition " + entry.name + ".");
+        }
+        partitions.emplace_back(new Partition());
+        partitions.back()->name = entry.name;
+        partitions.back()->minConnections = entry.minConnections;
+        partitions.back()->maxConnections = entry.maxConnections;
+        reserved += entry.minConnections;
+    }
+    if (reserved > options.numConnection)
+        throw std::invalid_argument("Pool partitions reserve more connections than the pool holds.");
+
+    for (auto &partition : partitions)
+    {
+        partition->leased = 0;
+        partition->lastLease = 0;
+    }
+    partitions[0]->minConnections = 0;
+    partitions[0]->maxConnections = 0;
+}
+
+/**
+ * @brief Count a lease against a partition if its limits allow it.
+ *
+ * @returns false when the partition is at its maximum, or when it would
+ * borrow a connection reserved by a partition in use.
+ */
+bool ConnectionPool::admitPartition(int partition)
+{
+    Partition &self = *partitions[partition];
+    long long now = std::chrono::steady_clock::now().time_since_epoch().count();
+    long long idleAfter = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::milliseconds(PARTITION_IDLE_MS))
+                              .count();
+
+    std::lock_guard<std::mutex> lock(partitionMutex);
+    int leased = self.leased.load(std::memory_order_relaxed);
+    if (self.maxConnections > 0 && leased >= self.maxConnections)
+        return false;
+
+    if (leased >= self.minConnections)
+    {
+        // beyond the reservation: keep enough for the others' unused reservations
+        int total = 0;
+        int held = 0;
+        for (auto &other : partitions)
+        {
+            int otherLeased = other->leased.load(std::memory_order_relaxed);
+            total += otherLeased;
+            bool inUse = otherLeased > 0 || now - other->lastLease.load(std::memory_order_relaxed) < idleAfter;
+            if (other.get() != &self && inUse)
+                held += std::max(0, other->minConnections - otherLeased);
+        }
+        if (total + 1 + held > targetSize.load(std::memory_order_relaxed))
+            return false;
+    }
+
+    self.leased.fetch_add(1, std::memory_order_relaxed);
+    self.lastLease.store(now, std::memory_order_relaxed);
+    return true;
+}
+
+bool ConnectionPool::OpenPoolConnections()
+{
+    try
+    {
+        ClosePoolConnections();
+        // return true if no exception is thrown
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        // return false if an exception is thrown
+        return false;
+    }
+}
+
+/**
+ * @brief Close every idle connection of the pool.
+ *
+ * Connections currently leased are left untouched so that no query is cut
+ * off mid-flight; they go back to the free list when released and are picked
+ * up again by the next reset.
+ */
+void ConnectionPool::ClosePoolConnections()
+{
+    hasActiveConnections = false;
+    int ind;
+    while (popAnyIdle(ind))
+    {
+        slotState[ind] = SLOT_BUSY;
+        if (mySqlPtrList[ind] != nullptr)
+            mySqlPtrList[ind]->close();
+        slotState[ind] = SLOT_CLOSED;
+    }
+}
+
+/**
+ * @brief Stop handing out connections and close the pool once all leases are back.
+ *
+ * New calls to GetConnecion fail immediately. Idle connections are closed in
+ * parallel once every leased connection has been released or the deadline
+ * passes; connections released after the deadline are closed on release.
+ *
+ * @param deadline point in time after which the pool stops waiting for leases.
+ *
+ * @returns true if every leased connection was returned before the deadline.
+ */
+bool ConnectionPool::Drain(std::chrono::steady_clock::time_point deadline)
+{
+    draining = true;
+    hasActiveConnections = false;
+    stopMaintenance();
+
+    bool drained = false;
+    while (true)
+    {
+        drained = leasedCount.load() == 0;
+        if (drained || std::chrono::steady_clock::now() >= deadline)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::vector<int> idle;
+    int ind;
+    while (popAnyIdle(ind) || retireList->pop(ind))
+    {
+        slotState[ind] = SLOT_BUSY;
+        idle.push_back(ind);
+    }
+
+    std::vector<std::thread> closers;
+    for (int i : idle)
+    {
+        SQLConnection *sqlPtr = mySqlPtrList[i].get();
+        if (sqlPtr != nullptr)
+            closers.emplace_back([sqlPtr]() { sqlPtr->close(); });
+    }
+    for (auto &closer : closers)
+        closer.join();
+    for (int i : idle)
+        slotState[i] = SLOT_CLOSED;
+
+    return drained;
+}
+
+/**
+ * @brief Reconnect every connection of the pool.
+ *
+ * On a live pool the connections are replaced one at a time by the
+ * maintenance thread, so capacity never drops by more than one connection.
+ * A pool that was closed is reconnected right away.
+ */
+void ConnectionPool::ResetPoolConnections()
+{
+    bool success = false;
+    if (draining)
+        return;
+
+    if (hasActiveConnections)
+    {
+        generation++;
+        return;
+    }
+
+    ClosePoolConnections();
+    for (size_t i = 0; i < slotCapacity; i++)
+    {
+        // skip empty slots and connections still in use or released back since the close
+        int expected = SLOT_CLOSED;
+        if (!slotState[i].compare_exchange_strong(expected, SLOT_BUSY))
+            continue;
+
+        SQLConnection *sqlPtr = mySqlPtrList[i].get();
+        runOnHomeNode(i, [&]() {
+            success = sqlPtr->connect();
+            if (success)
+                initializeConnection(sqlPtr);
+        });
+        if (success)
+        {
+            slotState[i] = SLOT_IDLE;
+            pushIdle(i);
+        }
+        else
+        {
+            std::cerr << "Connection pool failed. Cannot connect to server." << std::endl;
+            slotState[i] = SLOT_CLOSED;
+            ClosePoolConnections();
+            return;
+        }
+    }
+
+    if (idleCount() > 0 || leasedCount.load() > 0)
+        hasActiveConnections = true;
+}
+
+/**
+ * @brief Switch the pool to a new server, credentials or size without downtime.
+ *
+ * The new settings apply to every connection created from now on. Existing
+ * connections are replaced one at a time by the maintenance thread: idle ones
+ * right away, leased ones once they are released. Growing the pool adds
+ * connections in the background, shrinking it retires the extra ones as they
+ * become idle.
+ *
+ * @param server mysql server name or ip address.
+ * @param port mysql server port.
+ * @param user mysql user name.
+ * @param password mysql user password.
+ * @param database mysql database name.
+ * @param numConnection number of connection the pool should hold.
+ */
+void ConnectionPool::Reconfigure(std::string server, int port, std::string user, std::string password, std::string database, int numConnection)
+{
+    PoolOptions updated = GetOptions();
+    updated.server = server;
+    updated.port = port;
+    updated.user = user;
+    updated.password = password;
+    updated.database = database;
+    updated.numConnection = numConnection;
+    Reconfigure(updated);
+}
+
+/**
+ * @brief Apply a new set of options to the running pool.
+ *
+ * Connections are only replaced when a setting they were opened with
+ * changed; sizing, lifetime and acquire timeout changes apply in place. The
+ * pool cannot grow past the maxConnections it was created with.
+ *
+ * @param options the complete new configuration.
+ */
+void ConnectionPool::Reconfigure(const PoolOptions &options)
+{
+    if (options.server.empty() || options.user.empty())
+    {
+        throw std::invalid_argument("Server or user name is empty.");
+    }
+
+    if (options.verbose)
+        std::cout << "Reconfiguring connection pool server=" << options.server << " database=" << options.database << std::endl;
+
+    lockPool();
+    bool reconnect = !this->options.SameConnectionSettings(options);
+    bool lifetimeChanged = this->options.maxLifetime != options.maxLifetime;
+    this->options = options;
+    if (this->options.numConnection > (int)slotCapacity)
+    {
+        std::cerr << "Pool size " << options.numConnection << " exceeds its capacity, using " << slotCapacity << "." << std::endl;
+        this->options.numConnection = slotCapacity;
+    }
+    targetSize = this->options.numConnection;
+    acquireTimeout = this->options.acquireTimeout;
+    maxLease = this->options.maxLease;
+    retryBudget->SetRates(this->options.retryBudgetRatio, this->options.retryBudgetMinPerSecond);
+    if (reconnect)
+        generation++;
+    if (lifetimeChanged)
+    {
+        for (size_t i = 0; i < slotCapacity; i++)
+            setExpiry(i);
+    }
+    unlockPool();
+}
+
+PoolOptions ConnectionPool::GetOptions()
+{
+    lockPool();
+    PoolOptions current = options;
+    unlockPool();
+    return current;
+}
+
+PoolOptions ConnectionPool::MakeOptions(std::string server, int port, std::string user, std::string password, std::string database, int numConnection)
+{
+    PoolOptions options;
+    options.server = server;
+    options.port = port;
+    options.user = user;
+    options.password = password;
+    options.database = database;
+    options.numConnection = numConnection;
+    return options;
+}
+
+/**
+ * @brief Check whether connections with outdated settings are still in the pool.
+ *
+ * @returns true until every connection matches the latest Reconfigure call.
+ */
+bool ConnectionPool::IsReconfiguring()
+{
+    bool pending = false;
+    int active = 0;
+    int target = targetSize;
+    for (size_t i = 0; i < slotCapacity; i++)
+    {
+        if (slotState[i] == SLOT_EMPTY || slotState[i] == SLOT_REMOVED)
+            continue;
+        active++;
+        if ((int)i >= target || slotGeneration[i] != generation)
+            pending = true;
+    }
+    if (active != target)
+        pending = true;
+    return pending;
+}
+
+/**
+ * @brief Retire connections once they reach a maximum age.
+ *
+ * Each connection gets its own age limit, picked at random between
+ * LIFETIME_JITTER_PERCENT below seconds and seconds, so connections opened
+ * together are not all recycled together. Expired connections are replaced
+ * by the maintenance thread after they are released, never while a caller
+ * waits in GetConnecion.
+ *
+ * @param seconds maximum connection age, 0 to keep connections forever.
+ */
+void ConnectionPool::SetMaxLifetime(unsigned int seconds)
+{
+    lockPool();
+    options.maxLifetime = seconds;
+    for (size_t i = 0; i < slotCapacity; i++)
+        setExpiry(i);
+    unlockPool();
+}
+
+/**
+ * @brief Limit how long a connection may stay leased.
+ *
+ * Once a lease is older than the limit, the maintenance thread kills the
+ * connection's server session, which stops its running statement and rolls
+ * back its transaction, revokes it so that further queries fail at once, and
+ * opens a fresh connection in its slot. The holder still has to release the
+ * revoked connection, which is then freed.
+ *
+ * @param seconds longest lease, 0 for no limit.
+ */
+void ConnectionPool::SetMaxLease(unsigned int seconds)
+{
+    lockPool();
+    options.maxLease = seconds;
+    maxLease = seconds;
+    unlockPool();
+}
+
+/**
+ * @brief Register the hook run on every connection the pool opens from now on.
+ *
+ * The hook runs on the constructor or maintenance thread, before the
+ * connection is queued, so no caller ever waits for it.
+ *
+ * @param initializer the hook, or nullptr to remove it.
+ */
+void ConnectionPool::SetConnectionInitializer(ConnectionInitializer initializer)
+{
+    lockPool();
+    this->initializer = initializer;
+    unlockPool();
+}
+
+/**
+ * @brief Build an initializer that primes session state and hot statements.
+ *
+ * Prepared statements are looked up by a hash of their exact text, so a
+ * warmed-up statement is only reused by SQL() templates, and checkQuery or
+ * selectQuery calls with a template, whose text is byte for byte the same:
+ * a difference in case, spacing or a literal prepares a second statement.
+ *
+ * @param sessionStatements statements run first, e.g. SET SESSION ...
+ * @param preparedStatements queries prepared and kept on the connection.
+ * @param warmupQueries queries run once and discarded to warm server caches.
+ *
+ * @returns the initializer to pass to the pool.
+ */
+ConnectionInitializer ConnectionPool::MakeWarmup(
+    std::vector<std::string> sessionStatements,
+    std::vector<std::string> preparedStatements,
+    std::vector<std::string> warmupQueries)
+{
+    return [sessionStatements, preparedStatements, warmupQueries](SQLConnection *sqlPtr) {
+        bool success = true;
+        std::string error;
+        for (const auto &statement : sessionStatements)
+        {
+            if (!sqlPtr->checkQuery(statement, error))
+            {
+                std::cerr << "Warm-up statement failed: " << error << std::endl;
+                success = false;
+            }
+        }
+        for (const auto &query : preparedStatements)
+        {
+            if (!sqlPtr->prepare(query, error))
+            {
+                std::cerr << "Warm-up prepare failed: " << error << std::endl;
+                success = false;
+            }
+        }
+        for (const auto &query : warmupQueries)
+        {
+            error.clear();
+            sqlPtr->selectQuery(query, error);
+            if (!error.empty())
+            {
+                std::cerr << "Warm-up query failed: " << error << std::endl;
+                success = false;
+            }
+        }
+        return success;
+    };
+}
+
+void ConnectionPool::initializeConnection(SQLConnection *sqlPtr)
+{
+    lockPool();
+    ConnectionInitializer hook = initializer;
+    unlockPool();
+
+    if (hook && !hook(sqlPtr))
+        std::cerr << "Connection initializer failed for pool connection " << sqlPtr->getPoolId() << "." << std::endl;
+}
+
+// must be called with the pool lock held
+std::chrono::steady_clock::time_point ConnectionPool::nextExpiry()
+{
+    if (options.maxLifetime == 0)
+        return std::chrono::steady_clock::time_point::max();
+
+    std::chrono::milliseconds lifetime(options.maxLifetime * 1000ULL);
+    std::uniform_int_distribution<long long> jitter(0, lifetime.count() * LIFETIME_JITTER_PERCENT / 100);
+    return std::chrono::steady_clock::now() + lifetime - std::chrono::milliseconds(jitter(jitterEngine));
+}
+
+// must be called with the pool lock held
+void ConnectionPool::setExpiry(int ind)
+{
+    slotExpiry[ind].store(nextExpiry().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+int ConnectionPool::localShard()
+{
+    if (shardCount == 1)
+        return 0;
+    int cpu = sched_getcpu();
+    if (!cpuShard.empty())
+        return cpu >= 0 && cpu < (int)cpuShard.size() ? cpuShard[cpu] : 0;
+    return cpu < 0 ? 0 : cpu % shardCount;
+}
+
+/**
+ * @brief Use one shard per NUMA node.
+ *
+ * Threads then take connections from the shard of the node they run on, and
+ * runOnHomeNode opens each connection from a thread bound to its shard's
+ * node, so the SQLConnection, its MYSQL handle and network buffers are
+ * allocated in that node's memory.
+ */
+void ConnectionPool::setupNumaShards()
+{
+#ifdef MYSQLPOOL_HAVE_NUMA
+    if (numa_available() < 0)
+    {
+        std::cerr << "NUMA is not available on this host, using " << shardCount << " shard(s)." << std::endl;
+        return;
+    }
+
+    for (int node = 0; node <= numa_max_node(); node++)
+    {
+        if (numa_bitmask_isbitset(numa_all_nodes_ptr, node))
+            shardNodes.push_back(node);
+    }
+    cpuShard.assign(numa_num_configured_cpus(), 0);
+    for (size_t cpu = 0; cpu < cpuShard.size(); cpu++)
+    {
+        int node = numa_node_of_cpu(cpu);
+        for (size_t shard = 0; shard < shardNodes.size(); shard++)
+        {
+            if (shardNodes[shard] == node)
+                cpuShard[cpu] = shard;
+        }
+    }
+
+    // the constructor allocates one free list per shard
+    shardCount = shardNodes.size();
+#else
+    std::cerr << "Built without libnuma, ignoring the numa option." << std::endl;
+#endif
+}
+
+/**
+ * @brief Run fn on a thread bound to the NUMA node of a slot's shard.
+ *
+ * Runs fn on the calling thread when the pool is not NUMA aware.
+ *
+ * @param ind slot whose home node is used.
+ * @param fn work that allocates the slot's connection.
+ */
+void ConnectionPool::runOnHomeNode(int ind, const std::function<void()> &fn)
+{
+#ifdef MYSQLPOOL_HAVE_NUMA
+    if (!shardNodes.empty())
+    {
+        int node = shardNodes[ind % shardCount];
+        std::thread worker([node, &fn]() {
+            numa_run_on_node(node);
+            numa_set_preferred(node);
+            fn();
+        });
+        worker.join();
+        return;
+    }
+#endif
+    fn();
+}
+
+/**
+ * @brief Take an idle slot, from the calling CPU's shard when possible.
+ *
+ * When the local shard is empty the other shards are tried in order,
+ * starting with the next one, so threads on neighbouring CPUs steal from
+ * each other first.
+ *
+ * @returns false if every shard is empty.
+ */
+bool ConnectionPool::popIdle(int &ind)
+{
+    int local = localShard();
+    for (int i = 0; i < shardCount; i++)
+    {
+        while (freeLists[(local + i) % shardCount]->pop(ind))
+        {
+            if (claimPopped(ind))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool ConnectionPool::popAnyIdle(int &ind)
+{
+    for (int i = 0; i < shardCount; i++)
+    {
+        while (freeLists[i]->pop(ind))
+        {
+            if (claimPopped(ind))
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Take a slot just popped off a free list, leaving it SLOT_BUSY.
+ *
+ * @returns false if the maintenance thread claimed the slot in the list;
+ * it is then left out of the list for the maintenance thread to put back.
+ */
+bool ConnectionPool::claimPopped(int ind)
+{
+    while (true)
+    {
+        int expected = SLOT_IDLE;
+        if (slotState[ind].compare_exchange_strong(expected, SLOT_BUSY, std::memory_order_acq_rel))
+            return true;
+        if (expected == SLOT_ROLLING)
+        {
+            if (slotState[ind].compare_exchange_strong(expected, SLOT_DROPPED, std::memory_order_acq_rel))
+                return false;
+        }
+        else if (expected == SLOT_REMOVED)
+        {
+            if (slotState[ind].compare_exchange_strong(expected, SLOT_EMPTY, std::memory_order_acq_rel))
+                return false;
+        }
+        else
+            return false;
+    }
+}
+
+/**
+ * @brief Hand a slot claimed with SLOT_ROLLING, or owned as SLOT_BUSY,
+ * back as SLOT_IDLE or SLOT_EMPTY.
+ *
+ * A slot still in its free list is not pushed again; an emptied one stays
+ * SLOT_REMOVED until it is popped, so growPool cannot reuse it meanwhile.
+ */
+void ConnectionPool::finishRolling(int ind, int state)
+{
+    int expected = SLOT_ROLLING;
+    if (slotState[ind].compare_exchange_strong(expected, state == SLOT_IDLE ? SLOT_IDLE : SLOT_REMOVED, std::memory_order_acq_rel))
+        return;
+
+    // popped off the free list meanwhile, or never in it
+    slotState[ind].store(state, std::memory_order_release);
+    if (state == SLOT_IDLE)
+        pushIdle(ind);
+}
+
+void ConnectionPool::pushIdle(int ind)
+{
+    freeLists[ind % shardCount]->push(ind);
+}
+
+size_t ConnectionPool::idleCount()
+{
+    size_t count = 0;
+    for (int i = 0; i < shardCount; i++)
+        count += freeLists[i]->sizeApprox();
+    return count;
+}
+
+bool ConnectionPool::isStale(int ind)
+{
+    return ind >= targetSize.load(std::memory_order_relaxed) ||
+           slotGeneration[ind].load(std::memory_order_relaxed) != generation.load(std::memory_order_relaxed) ||
+           slotExpiry[ind].load(std::memory_order_relaxed) <= std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+void ConnectionPool::stopMaintenance()
+{
+    maintenanceRunning = false;
+    if (maintenanceThread.joinable() && maintenanceThread.get_id() != std::this_thread::get_id())
+        maintenanceThread.join();
+}
+
+void ConnectionPool::maintenanceLoop()
+{
+    while (maintenanceRunning)
+    {
+        // a Reconfigure may have fixed what made reconnects fail
+        if (backoffGeneration != generation)
+        {
+            backoffGeneration = generation;
+            slotFailures.assign(slotCapacity, 0);
+            for (size_t i = 0; i < slotCapacity; i++)
+                slotRetryAt[i].store(0, std::memory_order_relaxed);
+        }
+
+        int ind;
+        if (retireList->pop(ind))
+        {
+            replaceConnection(ind);
+            continue;
+        }
+
+        if (reclaimExpiredLease())
+            continue;
+
+        updateSizing();
+
+        if (!rollIdleConnection() && !growPool())
+            std::this_thread::sleep_for(std::chrono::milliseconds(MAINTENANCE_INTERVAL_MS));
+    }
+}
+
+/**
+ * @brief Close the sizing interval once it is over: turn the lease counters
+ * into metrics and a recommended pool size, and log them.
+ */
+void ConnectionPool::updateSizing()
+{
+    PoolOptions current = GetOptions();
+    auto now = std::chrono::steady_clock::now();
+    if (current.sizingInterval == 0 || now - sizingStart < std::chrono::seconds(current.sizingInterval))
+        return;
+
+    LeaseWindow window;
+    for (auto &stats : leaseStats)
+        stats->Collect(window);
+    double seconds = std::chrono::duration<double>(now - sizingStart).count();
+    sizingStart = now;
+
+    PoolMetrics computed;
+    computed.intervalSeconds = seconds;
+    computed.acquires = window.acquires;
+    computed.timeouts = window.timeouts;
+    computed.arrivalRate = (window.acquires + window.timeouts) / seconds;
+    double meanHold = window.releases > 0 ? window.holdNanos / 1e9 / window.releases : 0;
+    computed.meanHoldMs = meanHold * 1000;
+    computed.offeredLoad = computed.arrivalRate * meanHold;
+    computed.waitPercentileMs = window.WaitPercentile(current.sizingPercentile);
+    computed.recommendedSize = RecommendPoolSize(
+        computed.arrivalRate, meanHold, current.sizingPercentile, current.sizingMaxWaitMs / 1000.0);
+
+    lockPool();
+    metrics = computed;
+    unlockPool();
+
+    if (current.verbose)
+        std::cout << "Pool sizing: size=" << targetSize << " rate=" << computed.arrivalRate
+                  << "/s hold=" << computed.meanHoldMs << "ms load=" << computed.offeredLoad
+                  << " wait_p" << current.sizingPercentile * 100 << "=" << computed.waitPercentileMs
+                  << "ms timeouts=" << computed.timeouts << " recommended=" << computed.recommendedSize << std::endl;
+}
+
+/**
+ * @brief Lease rates, hold times and the advised pool size.
+ *
+ * The interval figures come from the last completed sizing interval, the
+ * size, leased and idle counts are current.
+ */
+PoolMetrics ConnectionPool::GetMetrics()
+{
+    lockPool();
+    PoolMetrics current = metrics;
+    unlockPool();
+    current.size = targetSize;
+    current.leased = leasedCount;
+    current.idle = (int)idleCount();
+    return current;
+}
+
+/**
+ * @brief Take back one connection leased for longer than maxLease.
+ *
+ * The slot is left empty for growPool to fill with a fresh connection; the
+ * old object stays in revokedList until its holder releases it.
+ *
+ * @returns true if a lease was revoked.
+ */
+bool ConnectionPool::reclaimExpiredLease()
+{
+    unsigned int limit = maxLease.load(std::memory_order_relaxed);
+    if (limit == 0)
+        return false;
+
+    long long cutoff = (std::chrono::steady_clock::now() - std::chrono::seconds(limit)).time_since_epoch().count();
+    for (size_t i = 0; i < slotCapacity; i++)
+    {
+        if (slotState[i] != SLOT_LEASED)
+            continue;
+        // the sequence is read first: a lease it counts has its time stored
+        unsigned long long seq = slotLeaseSeq[i].load(std::memory_order_acquire);
+        if (slotLeasedAt[i].load(std::memory_order_relaxed) > cutoff)
+            continue;
+
+        SQLConnection *sqlPtr = slotHolder[i].load(std::memory_order_acquire);
+        if (sqlPtr == nullptr)
+            continue;
+
+        unsigned long threadId;
+        {
+            // a holder that loses the swap frees its connection through
+            // releaseRevoked, which waits on revokedMutex until it is listed
+            std::lock_guard<std::mutex> lock(revokedMutex);
+            if (!slotHolder[i].compare_exchange_strong(sqlPtr, nullptr, std::memory_order_acq_rel))
+                continue;
+            if (slotLeaseSeq[i].load(std::memory_order_relaxed) != seq)
+            {
+                // released and leased again since its time was read: the same
+                // connection under a fresh lease, which keeps it; a release
+                // that lost the swap meanwhile takes it back in releaseRevoked
+                slotHolder[i].store(sqlPtr, std::memory_order_release);
+                continue;
+            }
+            slotState[i].store(SLOT_BUSY, std::memory_order_relaxed);
+            sqlPtr->revoke();
+            threadId = sqlPtr->getThreadId();
+            revokedList.push_back(std::move(mySqlPtrList[i]));
+        }
+        leasedCount.fetch_sub(1, std::memory_order_relaxed);
+        if (!partitions.empty())
+        {
+            partitions[slotPartition[i].load(std::memory_order_relaxed)]->leased.fetch_sub(1, std::memory_order_relaxed);
+            partitionReleased.notify_all();
+        }
+
+        // the holder may free the connection from here on
+        killLease(threadId);
+        std::cerr << "Revoked pool connection " << i << ", leased for more than " << limit << " seconds." << std::endl;
+        slotState[i] = SLOT_EMPTY;
+        growPool();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Kill the server session of a revoked lease from a new connection,
+ * as every pooled one may be in use.
+ */
+void ConnectionPool::killLease(unsigned long threadId)
+{
+    if (threadId == 0)
+        return;
+
+    SQLConnection killer(GetOptions());
+    std::string error;
+    if (!killer.connect(1) || !killer.checkQuery("KILL " + std::to_string(threadId), error))
+        std::cerr << "Cannot kill revoked pool connection: " << error << std::endl;
+    killer.close();
+}
+
+/**
+ * @brief Free a revoked connection once its holder gives it back.
+ *
+ * @returns true if the lease was not revoked after all, a reclaim having
+ * put it back, and has now been taken from its slot for a normal release.
+ */
+bool ConnectionPool::releaseRevoked(SQLConnection *sqlPtr)
+{
+    std::unique_ptr<SQLConnection> revoked;
+    {
+        std::lock_guard<std::mutex> lock(revokedMutex);
+        for (auto it = revokedList.begin(); it != revokedList.end(); ++it)
+        {
+            if (it->get() == sqlPtr)
+            {
+                revoked = std::move(*it);
+                revokedList.erase(it);
+                break;
+            }
+        }
+        if (revoked == nullptr)
+        {
+            SQLConnection *expected = sqlPtr;
+            return slotHolder[sqlPtr->getPoolId()].compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+        }
+    }
+    revoked->close();
+    return false;
+}
+
+/**
+ * @brief Replace one outdated idle connection.
+ *
+ * The replacement is opened while the old connection stays in the free
+ * list, and only then is the slot claimed where it sits, so callers never
+ * find fewer idle connections because of a swap. Slots whose last
+ * reconnect failed are skipped until their backoff has passed.
+ *
+ * @returns true if a connection was replaced or closed.
+ */
+bool ConnectionPool::rollIdleConnection()
+{
+    for (size_t i = 0; i < slotCapacity; i++)
+    {
+        if (slotState[i] != SLOT_IDLE || !isStale(i) || inBackoff(i))
+            continue;
+
+        int expected = SLOT_IDLE;
+        if ((int)i >= targetSize)
+        {
+            if (!slotState[i].compare_exchange_strong(expected, SLOT_ROLLING, std::memory_order_acq_rel))
+                continue;
+            return replaceConnection(i);
+        }
+
+        unsigned int freshGeneration;
+        std::unique_ptr<SQLConnection> fresh = openConnection(i, freshGeneration);
+        if (fresh == nullptr)
+        {
+            std::cerr << "Failed to replace pool connection " << i << ", keeping the old one." << std::endl;
+            return false;
+        }
+        if (!slotState[i].compare_exchange_strong(expected, SLOT_ROLLING, std::memory_order_acq_rel))
+        {
+            // leased meanwhile, it is swapped once released
+            fresh->close();
+            return false;
+        }
+        std::unique_ptr<SQLConnection> old = installConnection(i, std::move(fresh), freshGeneration);
+        finishRolling(i, SLOT_IDLE);
+        old->close();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Open one more connection when the pool is below its configured size.
+ *
+ * @returns true if a connection was added.
+ */
+bool ConnectionPool::growPool()
+{
+    int target = targetSize;
+    int active = 0;
+    int ind = -1;
+    for (size_t i = 0; i < slotCapacity; i++)
+    {
+        int state = slotState[i];
+        if (state != SLOT_EMPTY && state != SLOT_REMOVED)
+            active++;
+        else if (state == SLOT_EMPTY && ind < 0 && (int)i < target)
+            ind = i;
+    }
+    if (active >= target || ind < 0)
+        return false;
+
+    if (inBackoff(ind))
+        return false;
+    int expected = SLOT_EMPTY;
+    if (!slotState[ind].compare_exchange_strong(expected, SLOT_BUSY))
+        return false;
+
+    unsigned int freshGeneration;
+    std::unique_ptr<SQLConnection> fresh = openConnection(ind, freshGeneration);
+    if (fresh == nullptr)
+    {
+        std::cerr << "Connection pool failed to grow. Cannot connect to server." << std::endl;
+        slotState[ind] = SLOT_EMPTY;
+        return false;
+    }
+
+    installConnection(ind, std::move(fresh), freshGeneration);
+    slotState[ind] = SLOT_IDLE;
+    pushIdle(ind);
+    return true;
+}
+
+/**
+ * @brief Swap the connection of a slot owned by the maintenance thread.
+ *
+ * The replacement is opened before the old connection is closed. If it
+ * cannot connect, the old connection goes back to the free list and the
+ * slot is not tried again before its backoff has passed. Slots beyond the
+ * configured size are closed and emptied.
+ *
+ * @param ind index of a SLOT_BUSY or SLOT_ROLLING slot in mySqlPtrList.
+ *
+ * @returns true if the connection was replaced or closed.
+ */
+bool ConnectionPool::replaceConnection(int ind)
+{
+    std::unique_ptr<SQLConnection> old;
+
+    if (ind >= targetSize)
+    {
+        old = std::move(mySqlPtrList[ind]);
+        finishRolling(ind, SLOT_EMPTY);
+        if (old != nullptr)
+            old->close();
+        return true;
+    }
+    if (inBackoff(ind))
+    {
+        finishRolling(ind, SLOT_IDLE);
+        return false;
+    }
+
+    unsigned int freshGeneration;
+    std::unique_ptr<SQLConnection> fresh = openConnection(ind, freshGeneration);
+    bool success = fresh != nullptr;
+    if (success)
+        old = installConnection(ind, std::move(fresh), freshGeneration);
+    else
+        std::cerr << "Failed to replace pool connection " << ind << ", keeping the old one." << std::endl;
+
+    finishRolling(ind, SLOT_IDLE);
+
+    if (old != nullptr)
+        old->close();
+    return success;
+}
+
+/**
+ * @brief Open and initialize a connection for a slot with the current
+ * options, and update the slot's reconnect backoff.
+ *
+ * Every attempt takes a token from the retry budget and is made once: the
+ * slot's backoff spaces out the next attempt, not the connect retries of
+ * SQLConnection. Without a token the slot backs off as if it had failed.
+ *
+ * @param freshGeneration set to the generation of the options used.
+ *
+ * @returns the connection, or nullptr if it could not connect.
+ */
+std::unique_ptr<SQLConnection> ConnectionPool::openConnection(int ind, unsigned int &freshGeneration)
+{
+    PoolOptions freshOptions = GetOptions();
+    freshGeneration = generation;
+    if (!retryBudget->TryRetry())
+    {
+        std::cerr << "Not reconnecting pool connection " << ind << ", retry budget exhausted." << std::endl;
+        recordReconnect(ind, false);
+        return nullptr;
+    }
+
+    std::unique_ptr<SQLConnection> fresh;
+    bool success = false;
+    runOnHomeNode(ind, [&]() {
+        fresh.reset(new SQLConnection(freshOptions, ind, retryBudget));
+        success = fresh->connect(1);
+        if (success)
+            initializeConnection(fresh.get());
+    });
+
+    recordReconnect(ind, success);
+    if (!success)
+        fresh.reset();
+    return fresh;
+}
+
+/**
+ * @brief Put a fresh connection in a slot owned by the maintenance thread.
+ *
+ * @returns the connection it replaces, if any.
+ */
+std::unique_ptr<SQLConnection> ConnectionPool::installConnection(
+    int ind, std::unique_ptr<SQLConnection> fresh, unsigned int freshGeneration)
+{
+    std::unique_ptr<SQLConnection> old = std::move(mySqlPtrList[ind]);
+    mySqlPtrList[ind] = std::move(fresh);
+    slotGeneration[ind] = freshGeneration;
+    lockPool();
+    setExpiry(ind);
+    unlockPool();
+    return old;
+}
+
+bool ConnectionPool::inBackoff(int ind)
+{
+    return std::chrono::steady_clock::now().time_since_epoch().count() < slotRetryAt[ind].load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Start over after a successful connect, or double the wait before
+ * the slot is tried again, from MAINTENANCE_INTERVAL_MS up to
+ * RECONNECT_BACKOFF_MAX_MS.
+ */
+void ConnectionPool::recordReconnect(int ind, bool success)
+{
+    if (success)
+    {
+        slotFailures[ind] = 0;
+        slotRetryAt[ind].store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    unsigned int failures = std::min(slotFailures[ind]++, 16u);
+    unsigned long long delay = std::min<unsigned long long>(
+        (unsigned long long)MAINTENANCE_INTERVAL_MS << failures, RECONNECT_BACKOFF_MAX_MS);
+    slotRetryAt[ind].store((std::chrono::steady_clock::now() + std::chrono::milliseconds(delay)).time_since_epoch().count(),
+                           std::memory_order_relaxed);
+}
@@ -4,228 +4,202 @@
 #include <vector>
 #include <map>
 #include <chrono>
-#include <unordered_set>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
 
 #include "SQLConnection.h"
-#include "concurrentqueue.h"
+#include "SlotFreeList.h"
+#include "PoolSizing.h"
+
+/**
+ * Called on every new connection before it is handed out. Returning false
+ * only logs a warning, the connection is still added to the pool.
+ */
+typedef std::function<bool(SQLConnection *)> ConnectionInitializer;
+
+struct PartitionStats
+{
+    std::string name;
+    int minConnections;
+    int maxConnections;
+    int leased;
+};
 
 class ConnectionPool
 {
 public:
     ConnectionPool(
         std::string server, int port, std::string user,
-        std::string password, std::string database, int numConnection);
+        std::string password, std::string database, int numConnection,
+        ConnectionInitializer initializer = nullptr);
+    ConnectionPool(const PoolOptions &options, ConnectionInitializer initializer = nullptr);
 
     ~ConnectionPool();
 
+    static const unsigned int DRAIN_TIMEOUT_SECONDS = 30;
+    static const unsigned int MAINTENANCE_INTERVAL_MS = 100;
+    static const unsigned int LIFETIME_JITTER_PERCENT = 20;
+    static const unsigned int PARTITION_IDLE_MS = 1000; // before a reservation is lent out
+    static const unsigned int PARTITION_WAIT_MS = 10;   // most a refused lease waits for a release
+    static const unsigned int RECONNECT_BACKOFF_MAX_MS = 30000; // between failed swaps of one slot
+
     SQLConnection *GetConnecion(unsigned int timeout = 0);
+    SQLConnection *GetConnecion(const std::string &partition, unsigned int timeout = 0);
+    SQLConnection *TryGetConnecion();
     bool ReleaseConnecion(SQLConnection *sqlPtr);
 
     bool OpenPoolConnections();
     void ResetPoolConnections();
     void ClosePoolConnections();
 
+    void Reconfigure(
+        std::string server, int port, std::string user,
+        std::string password, std::string database, int numConnection);
+    void Reconfigure(const PoolOptions &options);
+    bool IsReconfiguring();
+    PoolOptions GetOptions();
+    void SetMaxLifetime(unsigned int seconds);
+    void SetMaxLease(unsigned int seconds);
+    void SetConnectionInitializer(ConnectionInitializer initializer);
+
+    static ConnectionInitializer MakeWarmup(
+        std::vector<std::string> sessionStatements,
+        std::vector<std::string> preparedStatements,
+        std::vector<std::string> warmupQueries);
+
     bool HasActiveConnections();
+    bool Drain(std::chrono::steady_clock::time_point deadline);
+    std::shared_ptr<RetryBudget> GetRetryBudget();
+    std::vector<PartitionStats> GetPartitionStats();
+    PoolMetrics GetMetrics();
 
 private:
-    std::atomic_flag _pool_mutex;
-    bool hasActiveConnections;
-    std::unordered_set<int> Indexes;
-    moodycamel::ConcurrentQueue<int> connectionQueue;
-    std::vector<std::unique_ptr<SQLConnection>> mySqlPtrList;
-};
-
-/**
- * @brief Construct a new Connection Pool:: Connection Pool object
- *
- * @param server mysql server name or ip address.
- * @param port mysql server port.
- * @param user mysql user name.
- * @param password mysql user password.
- * @param database mysql database name.
- * @param numConnection number of connection to create.
- *
- * @returns ConnectionPool object that got created.
- */
-ConnectionPool::ConnectionPool(std::string server, int port, std::string user, std::string password, std::string database, int numConnection)
-{
-    if (server.empty() || user.empty())
-    {
-        throw std::invalid_argument("Server or user name is empty.");
-    }
-
-    std::cout << "Creating connection pool server=" << server << " database=" << database << std::endl;
-
-    hasActiveConnections = false;
-    bool success = false;
-    try
-    {
-        _pool_mutex.test_and_set(std::memory_order_acquire);
-        for (int i = 0; i < numConnection; i++)
-        {
-            mySqlPtrList.emplace_back(
-                new SQLConnection(server, port, user, password, database, i));
-
-            success = mySqlPtrList[i]->connect();
-
-            if (success)
-            {
-                connectionQueue.enqueue(i);
-                Indexes.insert(i);
-            }
-            else
-            {
-                std::cerr << "Connection pool failed. Cannot connect to server." << std::endl;
-                ClosePoolConnections();
-                throw std::runtime_error("Failed to connect to server.");
-            }
-        }
-
-        size_t count = mySqlPtrList.size();
-        if (success && count > 0 && count == connectionQueue.size_approx())
-        {
-            hasActiveConnections = true;
-            std::cout << "Pool created successfully." << std::endl;
-        }
-        _pool_mutex.clear(std::memory_order_release);
-    }
-    catch (const std::exception &e)
-    {
-        ClosePoolConnections();
-        std::cerr << "Exception caught while creating connection pool: " << e.what() << std::endl;
-        throw; // rethrow the exception to be handled by the caller
-    }
-}
+    void lockPool();
+    void unlockPool();
 
-ConnectionPool::~ConnectionPool()
-{
-    // ClosePoolConnections();
-}
-
-bool ConnectionPool::HasActiveConnections()
-{
-    return hasActiveConnections;
-}
-
-SQLConnection *ConnectionPool::GetConnecion(unsigned int timeout)
-{
-    if (!hasActiveConnections)
-    {
-        std::cerr << "No active sql connection." << std::endl;
-        return nullptr;
-    }
-
-    if (timeout < 0)
-        std::cerr << "Error: Get connection Timeout value less then 0." << std::endl;
-
-    int ind;
-    bool success = false;
-    auto begin = std::chrono::system_clock::now();
-
-    do
+    struct Partition
     {
-        success = connectionQueue.try_dequeue(ind);
-        if (success && ind < mySqlPtrList.size())
-        {
-            _pool_mutex.test_and_set(std::memory_order_acquire);
-            auto it = Indexes.find(ind);
-            if (it != Indexes.end())
-                Indexes.erase(ind);
-            _pool_mutex.clear(std::memory_order_relaxed);
-            return mySqlPtrList[ind].get();
-        }
-
-        // set max waiting time to get connection
-        // return nullptr on time out
-        if (timeout > 0)
-        {
-            auto end = std::chrono::system_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(end - begin).count();
-            if (elapsed >= timeout)
-                return nullptr;
-        }
-
-    } while (!success);
-
-    return nullptr;
-}
-
-bool ConnectionPool::ReleaseConnecion(SQLConnection *sqlPtr)
-{
-    if (sqlPtr->getPoolId() > -1)
-    {
-        _pool_mutex.test_and_set(std::memory_order_acquire);
-        auto it = Indexes.find(sqlPtr->getPoolId());
-        if (it == Indexes.end())
-        {
-            connectionQueue.enqueue(sqlPtr->getPoolId());
-            Indexes.insert(sqlPtr->getPoolId());
-        }
-        _pool_mutex.clear(std::memory_order_release);
-        return true;
-    }
-    return false;
-}
-
-bool ConnectionPool::OpenPoolConnections()
-{
-    try
+        std::string name;
+        int minConnections;
+        int maxConnections;
+        std::atomic<int> leased;
+        std::atomic<long long> lastLease; // steady_clock ticks
+    };
+
+    enum SlotState
     {
-        ClosePoolConnections();
-        // return true if no exception is thrown
-        return true;
-    }
-    catch (const std::exception &e)
-    {
-        std::cerr << "Error: " << e.what() << std::endl;
-        // return false if an exception is thrown
-        return false;
-    }
-}
-
-void ConnectionPool::ClosePoolConnections()
-{
-    hasActiveConnections = false;
-    for (auto &sqlPtr : mySqlPtrList)
-    {
-        if (sqlPtr != nullptr && sqlPtr->isValide())
-            sqlPtr->close();
-    }
+        SLOT_EMPTY,  // no connection object
+        SLOT_IDLE,   // in its shard's free list, ready to be handed out
+        SLOT_LEASED, // handed out by GetConnecion
+        SLOT_BUSY,   // owned by the maintenance thread or a reset
+        SLOT_CLOSED, // closed, waiting for a reset
+        SLOT_ROLLING, // still in its free list, claimed by the maintenance thread for a swap
+        SLOT_DROPPED, // a rolling slot popped off its free list meanwhile
+        SLOT_REMOVED  // emptied while still in its free list, until it is popped
+    };
+
+    SQLConnection *acquire(int partition, unsigned int timeout, bool wait = true);
+    void setupPartitions(const std::vector<PoolPartition> &configured);
+    bool admitPartition(int partition);
+    bool isStale(int ind);
+    int localShard();
+    bool popIdle(int &ind);
+    bool popAnyIdle(int &ind);
+    bool claimPopped(int ind);
+    void finishRolling(int ind, int state);
+    void pushIdle(int ind);
+    size_t idleCount();
+    void setupNumaShards();
+    void runOnHomeNode(int ind, const std::function<void()> &fn);
+    void setExpiry(int ind);
+    void initializeConnection(SQLConnection *sqlPtr);
+    static PoolOptions MakeOptions(
+        std::string server, int port, std::string user,
+        std::string password, std::string database, int numConnection);
+    std::chrono::steady_clock::time_point nextExpiry();
+    void maintenanceLoop();
+    void stopMaintenance();
+    bool reclaimExpiredLease();
+    void killLease(unsigned long threadId);
+    bool releaseRevoked(SQLConnection *sqlPtr);
+    bool rollIdleConnection();
+    bool growPool();
+    bool replaceConnection(int ind);
+    std::unique_ptr<SQLConnection> openConnection(int ind, unsigned int &freshGeneration);
+    std::unique_ptr<SQLConnection> installConnection(
+        int ind, std::unique_ptr<SQLConnection> fresh, unsigned int freshGeneration);
+    bool inBackoff(int ind);
+    void recordReconnect(int ind, bool success);
+    void updateSizing();
 
-    _pool_mutex.test_and_set(std::memory_order_acquire);
-    connectionQueue = moodycamel::ConcurrentQueue<int>();
-    Indexes = std::unordered_set<int>();
-    _pool_mutex.clear(std::memory_order_release);
-}
+    std::atomic_flag _pool_mutex;
+    std::atomic<bool> hasActiveConnections;
+    std::atomic<bool> draining;
+    std::atomic<bool> maintenanceRunning;
+    std::thread maintenanceThread;
+
+    // guarded by _pool_mutex
+    PoolOptions options;
+    std::mt19937 jitterEngine;
+    ConnectionInitializer initializer;
+
+    // shared by every connection of the pool, set once in the constructor
+    std::shared_ptr<RetryBudget> retryBudget;
+
+    // read on the acquire and release paths without the lock
+    size_t slotCapacity;
+    std::atomic<int> targetSize;
+    std::atomic<unsigned int> acquireTimeout;
+    std::atomic<unsigned int> maxLease;
+    std::atomic<unsigned int> generation;
+    std::atomic<int> leasedCount;
+    std::unique_ptr<std::atomic<int>[]> slotState;
+    std::unique_ptr<std::atomic<unsigned int>[]> slotGeneration;
+    std::unique_ptr<std::atomic<long long>[]> slotExpiry;
+    std::unique_ptr<std::atomic<long long>[]> slotLeasedAt;
+    std::unique_ptr<std::atomic<unsigned long long>[]> slotLeaseSeq; // bumped by every lease, after slotLeasedAt
+    std::unique_ptr<std::atomic<long long>[]> slotRetryAt; // no reconnect before, steady_clock ticks
+    // connection leased from each slot, nullptr otherwise; whoever swaps it
+    // out, the holder's release or a revocation, owns the lease
+    std::unique_ptr<std::atomic<SQLConnection *>[]> slotHolder;
+    int shardCount;
+    std::vector<std::unique_ptr<SlotFreeList>> freeLists;
+    std::vector<int> shardNodes; // NUMA node of each shard, empty unless numaAware
+    std::vector<int> cpuShard;   // shard of each CPU, empty unless numaAware
+    std::unique_ptr<SlotFreeList> retireList;
+
+    // empty unless options.partitions is set; index 0 is the unnamed
+    // partition of GetConnecion calls without a name. Admission is checked
+    // under partitionMutex, leases are returned without it and wake the
+    // callers waiting on partitionReleased.
+    std::vector<std::unique_ptr<Partition>> partitions;
+    std::unique_ptr<std::atomic<int>[]> slotPartition;
+    std::mutex partitionMutex;
+    std::condition_variable partitionReleased;
+
+    // indexed like freeLists, by the slot's shard
+    std::vector<std::unique_ptr<LeaseStats>> leaseStats;
+    // owned by the maintenance thread
+    std::chrono::steady_clock::time_point sizingStart;
+    // guarded by _pool_mutex, refreshed every sizingInterval
+    PoolMetrics metrics;
+
+    // owned by the maintenance thread: failed connects in a row per slot
+    std::vector<unsigned int> slotFailures;
+    unsigned int backoffGeneration; // reset on a Reconfigure
+
+    // sized to slotCapacity, an entry only changes while its slot is SLOT_BUSY or SLOT_ROLLING
+    std::vector<std::unique_ptr<SQLConnection>> mySqlPtrList;
 
-void ConnectionPool::ResetPoolConnections()
-{
-    bool success = false;
-    ClosePoolConnections();
-    for (auto &sqlPtr : mySqlPtrList)
-    {
-        success = sqlPtr->connect();
-        if (success)
-        {
-            _pool_mutex.test_and_set(std::memory_order_acquire);
-            Indexes.insert(sqlPtr->getPoolId());
-            connectionQueue.enqueue(sqlPtr->getPoolId());
-            _pool_mutex.clear(std::memory_order_release);
-        }
-        else
-        {
-            std::cerr << "Connection pool failed. Cannot connect to server." << std::endl;
-            for (auto &sqlPtr : mySqlPtrList)
-            {
-                if (sqlPtr != nullptr && sqlPtr->isValide())
-                    sqlPtr->close();
-            }
-        }
-    }
-
-    size_t count = mySqlPtrList.size();
-    if (success && count > 0 && count == connectionQueue.size_approx())
-        hasActiveConnections = true;
-}
+    // connections taken back from their holders, freed once released
+    std::mutex revokedMutex;
+    std::vector<std::unique_ptr<SQLConnection>> revokedList;
+};
 
 #endif
@@ -0,0 +1,436 @@
+#include "HedgedReader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <errmsg.h>
+
+#include "SqlTemplate.h"
+
+constexpr double HedgedReader::DEFAULT_PERCENTILE;
+const unsigned int HedgedReader::DEFAULT_DELAY_MS;
+const size_t HedgedReader::LATENCY_SAMPLES;
+const size_t HedgedReader::MIN_SAMPLES;
+const size_t HedgedReader::MAX_FINGERPRINTS;
+
+/* one query of a read, on the primary (0) or the secondary (1) */
+struct HedgedReader::Attempt
+{
+    bool running = false;      // the query is on the server
+    bool killing = false;      // a KILL QUERY is queued or being sent for it
+    unsigned long threadId = 0; // server connection id
+};
+
+/* state shared by the caller and the attempt threads, guarded by mutex */
+struct HedgedReader::Read
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::string query;
+    uint64_t fingerprint = 0;
+    Attempt attempts[2];
+    int launched = 0;
+    int finished = 0;
+    int winner = -1;
+    std::vector<std::vector<std::string>> rows;
+    std::string error;
+};
+
+/**
+ * @brief Construct a new Hedged Reader:: Hedged Reader object
+ *
+ * @param primary pool every read goes to first.
+ * @param secondary pool slow reads are repeated on, e.g. another replica.
+ * @param percentile latency percentile of a fingerprint after which to hedge.
+ * @param defaultDelayMs delay used until enough latencies have been seen.
+ */
+HedgedReader::HedgedReader(
+    ConnectionPool *primary, ConnectionPool *secondary,
+    double percentile, unsigned int defaultDelayMs)
+{
+    this->pools[0] = primary;
+    this->pools[1] = secondary;
+    this->percentile = std::min(std::max(percentile, 0.0), 1.0);
+    this->defaultDelay = std::chrono::milliseconds(defaultDelayMs);
+    this->inflight = 0;
+    this->running = true;
+
+    killerThread = std::thread(&HedgedReader::killerLoop, this);
+}
+
+HedgedReader::~HedgedReader()
+{
+    {
+        // attempt threads wait for their kills, so the killer runs until they end
+        std::unique_lock<std::mutex> lock(inflightMutex);
+        inflightDone.wait(lock, [this]() { return inflight == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(killMutex);
+        running = false;
+    }
+    killQueued.notify_one();
+    if (killerThread.joinable())
+        killerThread.join();
+}
+
+/**
+ * @brief Fingerprint of a query's shape, used to group its latencies.
+ *
+ * Quoted strings and numbers are replaced by ?, and a comma separated run
+ * of them, e.g. an IN list, by a single ?, so reads that only differ in
+ * their values share one distribution. Case and whitespace are then folded
+ * as by SqlText::hashFingerprint.
+ */
+uint64_t HedgedReader::Fingerprint(const std::string &query)
+{
+    std::string shape;
+    shape.reserve(query.size());
+    auto isWord = [](char c) { return std::isalnum((unsigned char)c) || c == '_' || c == '$'; };
+    auto literal = [&shape]() {
+        size_t comma = shape.find_last_not_of(" \t\r\n");
+        if (comma != std::string::npos && comma > 0 && shape[comma] == ',')
+        {
+            size_t before = shape.find_last_not_of(" \t\r\n", comma - 1);
+            if (before != std::string::npos && shape[before] == '?')
+            {
+                shape.resize(before + 1);
+                return;
+            }
+        }
+        shape += '?';
+    };
+
+    size_t i = 0;
+    while (i < query.size())
+    {
+        char c = query[i];
+        if (c == '\'' || c == '"')
+        {
+            // a quote is escaped by a backslash or by doubling it
+            for (i++; i < query.size(); i++)
+            {
+                if (query[i] == '\\')
+                    i++;
+                else if (query[i] == c && (i + 1 == query.size() || query[i + 1] != c))
+                    break;
+                else if (query[i] == c)
+                    i++;
+            }
+            i++;
+            literal();
+        }
+        else if (c == '`')
+        {
+            size_t end = query.find('`', i + 1);
+            end = end == std::string::npos ? query.size() : end + 1;
+            shape.append(query, i, end - i);
+            i = end;
+        }
+        else if ((i == 0 || !isWord(query[i - 1])) &&
+                 (std::isdigit((unsigned char)c) ||
+                  (c == '.' && i + 1 < query.size() && std::isdigit((unsigned char)query[i + 1]))))
+        {
+            // 42, 1.5, 2e-3, 0x1f
+            bool hex = c == '0' && i + 1 < query.size() && (query[i + 1] == 'x' || query[i + 1] == 'X');
+            for (i++; i < query.size(); i++)
+            {
+                char d = query[i];
+                bool exponentSign = !hex && (d == '+' || d == '-') && (query[i - 1] == 'e' || query[i - 1] == 'E');
+                if (!isWord(d) && d != '.' && !exponentSign)
+                    break;
+            }
+            literal();
+        }
+        else
+            shape += query[i++];
+    }
+    return SqlText::hashFingerprint(shape.c_str());
+}
+
+/**
+ * @brief Run a read, hedging it on the secondary pool if it is slow.
+ *
+ * @param error set if both pools failed, to the last error.
+ *
+ * @returns the rows of the first successful answer.
+ */
+std::vector<std::vector<std::string>> HedgedReader::Select(const std::string &query, std::string &error)
+{
+    std::shared_ptr<Read> read = std::make_shared<Read>();
+    read->query = query;
+    read->fingerprint = Fingerprint(query);
+    auto delay = HedgeDelay(read->fingerprint);
+
+    startAttempt(read, 0);
+
+    std::unique_lock<std::mutex> lock(read->mutex);
+    bool answered = read->changed.wait_for(lock, delay, [&read]() {
+        return read->winner >= 0 || read->finished == read->launched;
+    });
+    if (!answered || (read->winner < 0 && read->finished == 1))
+    {
+        // too slow, or failed: try the secondary as well, budget permitting
+        lock.unlock();
+        std::shared_ptr<RetryBudget> budget = pools[0]->GetRetryBudget();
+        bool allowed = !budget || budget->TryRetry();
+        {
+            std::lock_guard<std::mutex> statsLock(latencyMutex);
+            if (allowed)
+                stats.hedged++;
+            else
+                stats.notHedged++;
+        }
+        if (allowed)
+            startAttempt(read, 1);
+        lock.lock();
+    }
+    read->changed.wait(lock, [&read]() {
+        return read->winner >= 0 || read->finished == read->launched;
+    });
+
+    int winner = read->winner;
+    std::vector<std::vector<std::string>> rows = std::move(read->rows);
+    if (winner < 0)
+        error = read->error;
+    lock.unlock();
+
+    // only queues the kill, the caller does not wait for it
+    if (winner >= 0 && read->launched == 2)
+        cancelAttempt(read, 1 - winner);
+
+    std::lock_guard<std::mutex> statsLock(latencyMutex);
+    stats.reads++;
+    if (winner == 1)
+        stats.hedgeWins++;
+    return rows;
+}
+
+/**
+ * @brief Lease a connection from one pool and run the query on a new thread.
+ */
+void HedgedReader::startAttempt(const std::shared_ptr<Read> &read, int which)
+{
+    {
+        std::lock_guard<std::mutex> lock(read->mutex);
+        read->launched++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(inflightMutex);
+        inflight++;
+    }
+
+    std::thread([this, read, which]() {
+        ConnectionPool *pool = pools[which];
+        SQLConnection *sqlPtr = pool->GetConnecion();
+        std::string error;
+        std::vector<std::vector<std::string>> rows;
+        auto begin = std::chrono::steady_clock::now();
+        bool ran = false;
+
+        if (sqlPtr == nullptr)
+            error = "ERROR: No connection available for hedged read.";
+        else
+        {
+            bool skip;
+            {
+                std::lock_guard<std::mutex> lock(read->mutex);
+                skip = read->winner >= 0;
+                read->attempts[which].running = !skip;
+                read->attempts[which].threadId = mysql_thread_id(sqlPtr->getHandle());
+            }
+            if (!skip)
+            {
+                rows = sqlPtr->selectQuery(read->query, error);
+                ran = true;
+            }
+
+            // keep the connection until a KILL QUERY aimed at it is done, so
+            // it cannot hit another lease's query
+            std::unique_lock<std::mutex> lock(read->mutex);
+            read->attempts[which].running = false;
+            read->changed.wait(lock, [&read, which]() { return !read->attempts[which].killing; });
+            lock.unlock();
+            pool->ReleaseConnecion(sqlPtr);
+        }
+
+        bool sample = false;
+        {
+            std::lock_guard<std::mutex> lock(read->mutex);
+            read->finished++;
+            // the primary's latency is sampled whether or not it won; a query
+            // killed because the secondary won counts with the time it ran,
+            // a lower bound that keeps slow reads in the distribution
+            sample = which == 0 && ran && (error.empty() || read->winner == 1);
+            if (error.empty() && read->winner < 0)
+            {
+                read->winner = which;
+                read->rows = std::move(rows);
+            }
+            else if (!error.empty() && read->winner < 0)
+                read->error = error;
+            read->changed.notify_all();
+        }
+        if (sample)
+            recordLatency(read->fingerprint, std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - begin));
+
+        std::lock_guard<std::mutex> lock(inflightMutex);
+        if (--inflight == 0)
+            inflightDone.notify_all();
+    }).detach();
+}
+
+/**
+ * @brief Queue a KILL QUERY for the losing query. The losing connection
+ * itself stays open.
+ */
+void HedgedReader::cancelAttempt(const std::shared_ptr<Read> &read, int which)
+{
+    {
+        std::lock_guard<std::mutex> lock(read->mutex);
+        Attempt &attempt = read->attempts[which];
+        if (!attempt.running)
+            return;
+        attempt.killing = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(killMutex);
+        kills.emplace_back(read, which);
+    }
+    killQueued.notify_one();
+}
+
+/**
+ * @brief Sends the queued kills, one at a time, until the reader is
+ * destroyed.
+ */
+void HedgedReader::killerLoop()
+{
+    std::unique_lock<std::mutex> lock(killMutex);
+    while (true)
+    {
+        killQueued.wait(lock, [this]() { return !running || !kills.empty(); });
+        if (kills.empty())
+            break;
+        std::shared_ptr<Read> read = std::move(kills.front().first);
+        int which = kills.front().second;
+        kills.pop_front();
+        lock.unlock();
+
+        unsigned long threadId = 0;
+        {
+            std::lock_guard<std::mutex> readLock(read->mutex);
+            if (read->attempts[which].running)
+                threadId = read->attempts[which].threadId;
+        }
+
+        // a query that ended while the kill was queued needs none
+        std::string error;
+        if (threadId != 0)
+        {
+            if (sendKill(which, threadId, error))
+            {
+                std::lock_guard<std::mutex> statsLock(latencyMutex);
+                stats.cancelled++;
+            }
+            else
+                std::cerr << "Cannot cancel hedged read: " << error << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> readLock(read->mutex);
+            read->attempts[which].killing = false;
+            read->changed.notify_all();
+        }
+        lock.lock();
+    }
+
+    for (auto &killer : killers)
+        killer.reset();
+}
+
+/**
+ * @brief Send KILL QUERY on the killer connection of a pool, opened with
+ * the pool's options on first use since every pooled one may be leased.
+ * A killer connection the server has dropped is reopened once.
+ */
+bool HedgedReader::sendKill(int which, unsigned long threadId, std::string &error)
+{
+    std::unique_ptr<SQLConnection> &killer = killers[which];
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!killer)
+        {
+            killer.reset(new SQLConnection(pools[which]->GetOptions()));
+            if (!killer->connect(1))
+            {
+                killer.reset();
+                error = "cannot connect";
+                return false;
+            }
+        }
+        error.clear();
+        if (killer->checkQuery("KILL QUERY " + std::to_string(threadId), error))
+            return true;
+        unsigned int code = killer->getErrorCode();
+        if (code != CR_SERVER_GONE_ERROR && code != CR_SERVER_LOST)
+            return false;
+        killer.reset();
+    }
+    return false;
+}
+
+void HedgedReader::recordLatency(uint64_t fingerprint, std::chrono::microseconds latency)
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    auto found = latencies.find(fingerprint);
+    if (found == latencies.end())
+    {
+        if (latencies.size() >= MAX_FINGERPRINTS)
+        {
+            latencies.erase(recentlyUsed.back());
+            recentlyUsed.pop_back();
+        }
+        recentlyUsed.push_front(fingerprint);
+        found = latencies.emplace(fingerprint, Samples()).first;
+        found->second.used = recentlyUsed.begin();
+    }
+    else
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.used);
+
+    std::deque<long long> &samples = found->second.values;
+    samples.push_back(latency.count());
+    if (samples.size() > LATENCY_SAMPLES)
+        samples.pop_front();
+}
+
+/**
+ * @brief How long a read of this fingerprint waits before it is hedged.
+ *
+ * The configured percentile of the last LATENCY_SAMPLES latencies of the
+ * primary, or the default delay until MIN_SAMPLES have been seen. Only the
+ * MAX_FINGERPRINTS most recently sampled fingerprints are kept.
+ *
+ * @param fingerprint as returned by Fingerprint().
+ */
+std::chrono::microseconds HedgedReader::HedgeDelay(uint64_t fingerprint)
+{
+    std::vector<long long> samples;
+    {
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        auto found = latencies.find(fingerprint);
+        if (found == latencies.end() || found->second.values.size() < MIN_SAMPLES)
+            return defaultDelay;
+        samples.assign(found->second.values.begin(), found->second.values.end());
+    }
+    size_t rank = std::min(samples.size() - 1, (size_t)(percentile * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return std::chrono::microseconds(samples[rank]);
+}
+
+HedgeStats HedgedReader::GetStats()
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    return stats;
+}
@@ -0,0 +1,104 @@
+#ifndef HEDGED_READER_H__ // #include guards
+#define HEDGED_READER_H__
+
+/* runs a read on a second replica pool when the first one is slow */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <thread>
+
+#include "ConnectionPool.h"
+
+struct HedgeStats
+{
+    unsigned long long reads = 0;
+    unsigned long long hedged = 0;    // reads that also went to the secondary
+    unsigned long long hedgeWins = 0; // hedged reads answered by the secondary
+    unsigned long long cancelled = 0; // losing queries killed on the server
+    unsigned long long notHedged = 0; // slow reads the retry budget did not allow to hedge
+};
+
+/**
+ * Sends a read to the primary pool and, if it has not answered within the
+ * configured percentile of the latencies seen for the query's fingerprint,
+ * sends it to the secondary pool as well. The first successful answer is
+ * returned and the other query is stopped with KILL QUERY, sent by a
+ * background thread that keeps one connection per pool for it.
+ *
+ * A hedge counts as a retry against the primary pool's retry budget and is
+ * skipped when the budget is empty.
+ *
+ * Only use it for reads that are safe to run twice. Both pools must outlive
+ * the reader; the destructor waits for queries still running.
+ */
+class HedgedReader
+{
+public:
+    HedgedReader(
+        ConnectionPool *primary, ConnectionPool *secondary,
+        double percentile = DEFAULT_PERCENTILE,
+        unsigned int defaultDelayMs = DEFAULT_DELAY_MS);
+
+    ~HedgedReader();
+
+    static constexpr double DEFAULT_PERCENTILE = 0.95;
+    static const unsigned int DEFAULT_DELAY_MS = 20;
+    static const size_t LATENCY_SAMPLES = 256; // kept per fingerprint
+    static const size_t MIN_SAMPLES = 20;      // before the percentile is trusted
+    static const size_t MAX_FINGERPRINTS = 1024; // least recently used ones are dropped
+
+    static uint64_t Fingerprint(const std::string &query);
+
+    std::vector<std::vector<std::string>> Select(const std::string &query, std::string &error);
+    std::chrono::microseconds HedgeDelay(uint64_t fingerprint);
+    HedgeStats GetStats();
+
+private:
+    struct Attempt;
+    struct Read;
+
+    void startAttempt(const std::shared_ptr<Read> &read, int which);
+    void cancelAttempt(const std::shared_ptr<Read> &read, int which);
+    void killerLoop();
+    bool sendKill(int which, unsigned long threadId, std::string &error);
+    void recordLatency(uint64_t fingerprint, std::chrono::microseconds latency);
+
+    struct Samples
+    {
+        std::deque<long long> values;
+        std::list<uint64_t>::iterator used; // position in recentlyUsed
+    };
+
+    ConnectionPool *pools[2];
+    double percentile;
+    std::chrono::microseconds defaultDelay;
+
+    // guarded by latencyMutex
+    std::mutex latencyMutex;
+    std::unordered_map<uint64_t, Samples> latencies;
+    std::list<uint64_t> recentlyUsed; // most recently used fingerprint first
+    HedgeStats stats;
+
+    std::mutex inflightMutex;
+    std::condition_variable inflightDone;
+    int inflight;
+
+    // guarded by killMutex
+    std::mutex killMutex;
+    std::condition_variable killQueued;
+    std::deque<std::pair<std::shared_ptr<Read>, int>> kills;
+    bool running;
+
+    std::unique_ptr<SQLConnection> killers[2]; // owned by the killer thread
+    std::thread killerThread;
+};
+
+#endif
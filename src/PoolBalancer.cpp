@@ -0,0 +1,386 @@
+#include "PoolBalancer.h"
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+const unsigned int PoolBalancer::DEFAULT_DECAY_MS;
+const unsigned int PoolBalancer::RETRY_INTERVAL_MS;
+const unsigned int PoolBalancer::AFFINITY_WAIT_MS;
+
+/**
+ * @brief Construct a new Pool Balancer:: Pool Balancer object
+ *
+ * @param pools pools of equivalent backends, at least one.
+ * @param policy how a backend is chosen for each lease.
+ * @param decayMs time for the latency estimate to forget a slow sample.
+ */
+PoolBalancer::PoolBalancer(std::vector<ConnectionPool *> pools, BalancePolicy policy, unsigned int decayMs)
+{
+    if (pools.empty())
+        throw std::invalid_argument("Pool balancer needs at least one pool.");
+
+    std::unordered_map<std::string, int> seen;
+    for (ConnectionPool *pool : pools)
+    {
+        PoolOptions options = pool->GetOptions();
+        std::string identity = options.server + ":" + std::to_string(options.port) + "/" + options.database;
+        // pools of one server get distinct identities, in constructor order
+        int duplicate = seen[identity]++;
+        if (duplicate > 0)
+            identity += "#" + std::to_string(duplicate);
+
+        backends.emplace_back(new Backend());
+        Backend &backend = *backends.back();
+        backend.pool = pool;
+        backend.hash = hashKey(identity);
+        backend.outstanding = 0;
+        backend.leases = 0;
+        backend.failures = 0;
+        backend.latency = 0;
+        backend.hasSample = false;
+        backend.sampled = std::chrono::steady_clock::now();
+    }
+    this->policy = policy;
+    this->nextBackend = 0;
+    this->decaySeconds = std::max(decayMs, 1u) / 1000.0;
+}
+
+/**
+ * @brief Lease a connection from the backend the policy picks.
+ *
+ * @param timeout seconds to wait for any backend, 0 to wait while one is healthy.
+ *
+ * @returns the connection, or nullptr if no backend had one in time.
+ */
+SQLConnection *PoolBalancer::GetConnecion(unsigned int timeout)
+{
+    return acquire([this]() { return order(); }, timeout);
+}
+
+/**
+ * @brief Lease a connection from the backend a routing key maps to.
+ *
+ * @param routingKey e.g. a tenant or user id.
+ * @param timeout seconds to wait for any backend, 0 to wait while one is healthy.
+ *
+ * @returns the connection, or nullptr if no backend had one in time.
+ */
+SQLConnection *PoolBalancer::GetConnecion(const std::string &routingKey, unsigned int timeout)
+{
+    return acquire([this, &routingKey]() { return rendezvousOrder(routingKey); }, timeout, AFFINITY_WAIT_MS);
+}
+
+/**
+ * @brief Backend a routing key currently maps to, healthy ones only.
+ *
+ * @returns index of the backend in constructor order, -1 if none is healthy.
+ */
+int PoolBalancer::BackendFor(const std::string &routingKey)
+{
+    std::vector<int> candidates = rendezvousOrder(routingKey);
+    return candidates.empty() ? -1 : candidates[0];
+}
+
+/**
+ * @brief Give a connection back to its pool and record the latency of the
+ * queries run on it during the lease.
+ *
+ * @returns false if the connection was not leased through this balancer.
+ */
+bool PoolBalancer::ReleaseConnecion(SQLConnection *sqlPtr)
+{
+    Lease lease;
+    {
+        std::lock_guard<std::mutex> lock(leaseMutex);
+        auto found = leases.find(sqlPtr);
+        if (found == leases.end())
+            return false;
+        lease = found->second;
+        leases.erase(found);
+    }
+
+    Backend &backend = *backends[lease.backend];
+    backend.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    StatementMetrics queries = sqlPtr->getQueryMetrics();
+    unsigned long long calls = queries.calls - lease.queries.calls;
+    if (calls > 0)
+        recordLatency(lease.backend, std::chrono::microseconds((queries.totalMicros - lease.queries.totalMicros) / calls));
+    return backend.pool->ReleaseConnecion(sqlPtr);
+}
+
+void PoolBalancer::SetPolicy(BalancePolicy policy)
+{
+    this->policy = policy;
+}
+
+BalancePolicy PoolBalancer::GetPolicy()
+{
+    return (BalancePolicy)policy.load();
+}
+
+/**
+ * @brief Counters and latency estimate of each backend, in constructor order.
+ */
+std::vector<BackendStats> PoolBalancer::GetStats()
+{
+    std::vector<BackendStats> result;
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < backends.size(); i++)
+    {
+        Backend &backend = *backends[i];
+        BackendStats stats;
+        stats.outstanding = backend.outstanding.load(std::memory_order_relaxed);
+        stats.leases = backend.leases.load(std::memory_order_relaxed);
+        stats.failures = backend.failures.load(std::memory_order_relaxed);
+        double latency = estimate((int)i, now);
+        stats.latencyMs = latency < 0 ? -1 : latency * 1000;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+/**
+ * @brief Backends to try, the policy's choice first and then the other
+ * healthy ones from cheapest to most expensive.
+ */
+std::vector<int> PoolBalancer::order()
+{
+    std::vector<int> healthy;
+    for (size_t i = 0; i < backends.size(); i++)
+    {
+        if (backends[i]->pool->HasActiveConnections())
+            healthy.push_back((int)i);
+    }
+    if (healthy.empty())
+        return healthy;
+
+    int first;
+    BalancePolicy current = (BalancePolicy)policy.load(std::memory_order_relaxed);
+    bool byLatency = current == BALANCE_PEAK_EWMA;
+    switch (current)
+    {
+    case BALANCE_ROUND_ROBIN:
+        first = healthy[nextBackend.fetch_add(1, std::memory_order_relaxed) % healthy.size()];
+        break;
+    case BALANCE_LEAST_OUTSTANDING:
+        first = *std::min_element(healthy.begin(), healthy.end(), [this](int a, int b) {
+            return cost(a, false) < cost(b, false);
+        });
+        break;
+    default:
+        first = pickTwo(healthy, byLatency);
+        break;
+    }
+
+    std::vector<int> result(1, first);
+    std::vector<std::pair<double, int>> rest;
+    for (int i : healthy)
+    {
+        if (i != first)
+            rest.emplace_back(cost(i, byLatency), i);
+    }
+    std::sort(rest.begin(), rest.end());
+    for (auto &entry : rest)
+        result.push_back(entry.second);
+    return result;
+}
+
+/**
+ * @brief Healthy backends by decreasing rendezvous score for the key.
+ *
+ * The score of a backend mixes the key's hash with the backend's, so each
+ * key ranks the backends in its own fixed order.
+ */
+std::vector<int> PoolBalancer::rendezvousOrder(const std::string &routingKey)
+{
+    uint64_t key = hashKey(routingKey);
+    std::vector<std::pair<uint64_t, int>> scored;
+    for (size_t i = 0; i < backends.size(); i++)
+    {
+        if (backends[i]->pool->HasActiveConnections())
+            scored.emplace_back(mix(key ^ backends[i]->hash), (int)i);
+    }
+    std::sort(scored.begin(), scored.end(), [](const std::pair<uint64_t, int> &a, const std::pair<uint64_t, int> &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    std::vector<int> result;
+    for (auto &entry : scored)
+        result.push_back(entry.second);
+    return result;
+}
+
+/* FNV-1a */
+uint64_t PoolBalancer::hashKey(const std::string &text)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text)
+        hash = (hash ^ c) * 1099511628211ULL;
+    return hash;
+}
+
+/* splitmix64 finalizer, spreads the combined hashes over all 64 bits */
+uint64_t PoolBalancer::mix(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief Power of two choices: the cheaper of two distinct random backends.
+ *
+ * Nearly as good as the cheapest of all, without every caller piling onto
+ * the same backend between two updates of its counters.
+ */
+int PoolBalancer::pickTwo(const std::vector<int> &healthy, bool byLatency)
+{
+    if (healthy.size() == 1)
+        return healthy[0];
+
+    static thread_local std::minstd_rand engine(std::random_device{}());
+    std::uniform_int_distribution<size_t> pick(0, healthy.size() - 1);
+    size_t a = pick(engine);
+    size_t b = pick(engine);
+    if (a == b)
+        b = (b + 1) % healthy.size();
+    return cost(healthy[a], byLatency) <= cost(healthy[b], byLatency) ? healthy[a] : healthy[b];
+}
+
+/**
+ * @brief Load of a backend: its leases in flight, weighted by its latency
+ * estimate when byLatency is set.
+ */
+double PoolBalancer::cost(int backend, bool byLatency)
+{
+    Backend &entry = *backends[backend];
+    double outstanding = entry.outstanding.load(std::memory_order_relaxed);
+    if (!byLatency)
+        return outstanding;
+
+    auto now = std::chrono::steady_clock::now();
+    double latency = estimate(backend, now);
+    if (latency < 0)
+        latency = priorLatency(now);
+    // no backend has a sample yet, all cost the same per lease
+    if (latency < 0)
+        return outstanding;
+    return latency * (outstanding + 1);
+}
+
+/**
+ * @brief Latency estimate of a backend, decayed toward zero for the time
+ * since its last sample.
+ *
+ * @returns seconds, or -1 if the backend has no sample yet.
+ */
+double PoolBalancer::estimate(int backend, std::chrono::steady_clock::time_point now)
+{
+    Backend &entry = *backends[backend];
+    std::lock_guard<std::mutex> lock(entry.latencyMutex);
+    if (!entry.hasSample)
+        return -1;
+    double elapsed = std::max(std::chrono::duration<double>(now - entry.sampled).count(), 0.0);
+    return entry.latency * std::exp(-elapsed / decaySeconds);
+}
+
+/**
+ * @brief Latency assumed for a backend without samples: the mean estimate
+ * of those with one, so a new backend is neither flooded as free nor
+ * starved as slow.
+ *
+ * @returns seconds, or -1 if no backend has a sample yet.
+ */
+double PoolBalancer::priorLatency(std::chrono::steady_clock::time_point now)
+{
+    double sum = 0;
+    int sampled = 0;
+    for (size_t i = 0; i < backends.size(); i++)
+    {
+        double latency = estimate((int)i, now);
+        if (latency >= 0)
+        {
+            sum += latency;
+            sampled++;
+        }
+    }
+    return sampled > 0 ? sum / sampled : -1;
+}
+
+/**
+ * @brief Lease from the first candidate with an idle connection.
+ *
+ * Candidates are listed again each round, so backends that become
+ * healthy or unhealthy meanwhile are taken into account.
+ *
+ * @param preferMs how long only the first candidate is tried.
+ */
+SQLConnection *PoolBalancer::acquire(const std::function<std::vector<int>()> &candidates,
+                                     unsigned int timeout, unsigned int preferMs)
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (bool first = true;; first = false)
+    {
+        std::vector<int> round = candidates();
+        if (round.empty())
+            break;
+        if (std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(preferMs))
+            round.resize(1);
+
+        for (int i : round)
+        {
+            Backend &backend = *backends[i];
+            SQLConnection *sqlPtr = backend.pool->TryGetConnecion();
+            if (sqlPtr == nullptr)
+            {
+                if (first)
+                    backend.failures.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            backend.outstanding.fetch_add(1, std::memory_order_relaxed);
+            backend.leases.fetch_add(1, std::memory_order_relaxed);
+            Lease lease;
+            lease.backend = i;
+            lease.queries = sqlPtr->getQueryMetrics();
+            std::lock_guard<std::mutex> lock(leaseMutex);
+            leases[sqlPtr] = lease;
+            return sqlPtr;
+        }
+
+        if (timeout > 0 && std::chrono::steady_clock::now() - begin >= std::chrono::seconds(timeout))
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(RETRY_INTERVAL_MS));
+    }
+
+    std::cerr << "No backend of the pool balancer has a connection available." << std::endl;
+    return nullptr;
+}
+
+/**
+ * @brief Fold a query latency sample into the backend's peak EWMA.
+ *
+ * A sample above the estimate, decayed as in estimate(), replaces it; a
+ * lower one is averaged in with a weight that grows with the time since
+ * the last sample. The first sample is taken as it is.
+ */
+void PoolBalancer::recordLatency(int backend, std::chrono::steady_clock::duration sample)
+{
+    Backend &entry = *backends[backend];
+    double seconds = std::chrono::duration<double>(sample).count();
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(entry.latencyMutex);
+    double elapsed = std::max(std::chrono::duration<double>(now - entry.sampled).count(), 0.0);
+    double keep = std::exp(-elapsed / decaySeconds);
+    if (!entry.hasSample || seconds > entry.latency * keep)
+        entry.latency = seconds;
+    else
+        entry.latency = entry.latency * keep + seconds * (1 - keep);
+    entry.hasSample = true;
+    entry.sampled = now;
+}
@@ -0,0 +1,124 @@
+#ifndef POOL_BALANCER_H__ // #include guards
+#define POOL_BALANCER_H__
+
+/* spreads leases over several pools of equivalent backends */
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "ConnectionPool.h"
+
+enum BalancePolicy
+{
+    BALANCE_ROUND_ROBIN,       // each backend in turn
+    BALANCE_LEAST_OUTSTANDING, // fewest leases in flight
+    BALANCE_POWER_OF_TWO,      // fewer leases in flight of two random backends
+    BALANCE_PEAK_EWMA          // lower latency * (leases in flight + 1) of two random backends
+};
+
+struct BackendStats
+{
+    int outstanding = 0;           // leases in flight through the balancer
+    double latencyMs = 0;          // peak EWMA of query round trips, -1 before the first
+    unsigned long long leases = 0;
+    unsigned long long failures = 0; // acquires that found no idle connection here
+};
+
+/**
+ * Leases connections from one of several ConnectionPools of equivalent
+ * backends, e.g. replicas of one primary, chosen by a BalancePolicy.
+ *
+ * The balancer counts the leases in flight on each backend and keeps a
+ * peak EWMA of its query latency, the mean round trip of the queries run
+ * during each lease: a slower sample replaces the estimate at once, faster
+ * ones pull it down over decayMs. Between samples the estimate decays
+ * toward zero over decayMs as well, so a backend that stopped being picked
+ * after a slow sample is tried again. Until its first sample, a backend is
+ * costed at the mean estimate of the others. Backends whose pool has no active
+ * connections are skipped. A pool without an idle connection is not waited
+ * on; the next best backend is tried, and once all were tried the round
+ * starts over after RETRY_INTERVAL_MS.
+ *
+ * With a routing key, the policy is bypassed for key affinity: rendezvous
+ * hashing maps the key to the same backend on every call, so a tenant's
+ * rows stay hot in one replica's buffer pool. While that backend is
+ * unhealthy the key goes to its next backend in hash order, and when a
+ * backend is added or removed only the keys mapped to it move. While it is
+ * only busy, the key waits up to AFFINITY_WAIT_MS for it before falling
+ * back to the next backends in hash order, none of which is waited on.
+ *
+ * Connections must be returned with the balancer's ReleaseConnecion. The
+ * pools must outlive the balancer.
+ */
+class PoolBalancer
+{
+public:
+    PoolBalancer(
+        std::vector<ConnectionPool *> pools,
+        BalancePolicy policy = BALANCE_PEAK_EWMA,
+        unsigned int decayMs = DEFAULT_DECAY_MS);
+
+    static const unsigned int DEFAULT_DECAY_MS = 10000;
+    static const unsigned int RETRY_INTERVAL_MS = 1; // between rounds over busy backends
+    static const unsigned int AFFINITY_WAIT_MS = 5;  // on a routing key's busy backend
+
+    SQLConnection *GetConnecion(unsigned int timeout = 0);
+    SQLConnection *GetConnecion(const std::string &routingKey, unsigned int timeout = 0);
+    int BackendFor(const std::string &routingKey);
+    bool ReleaseConnecion(SQLConnection *sqlPtr);
+
+    void SetPolicy(BalancePolicy policy);
+    BalancePolicy GetPolicy();
+    std::vector<BackendStats> GetStats();
+
+private:
+    struct Backend
+    {
+        ConnectionPool *pool;
+        uint64_t hash; // of server, port and database, for rendezvous hashing
+        std::atomic<int> outstanding;
+        std::atomic<unsigned long long> leases;
+        std::atomic<unsigned long long> failures;
+
+        // guarded by latencyMutex
+        std::mutex latencyMutex;
+        double latency;  // seconds, as of the last sample
+        bool hasSample;
+        std::chrono::steady_clock::time_point sampled;
+    };
+
+    struct Lease
+    {
+        int backend;
+        StatementMetrics queries; // of the connection when leased
+    };
+
+    std::vector<int> order();
+    std::vector<int> rendezvousOrder(const std::string &routingKey);
+    static uint64_t hashKey(const std::string &text);
+    static uint64_t mix(uint64_t value);
+    int pickTwo(const std::vector<int> &healthy, bool byLatency);
+    double cost(int backend, bool byLatency);
+    double estimate(int backend, std::chrono::steady_clock::time_point now);
+    double priorLatency(std::chrono::steady_clock::time_point now);
+    SQLConnection *acquire(const std::function<std::vector<int>()> &candidates,
+                           unsigned int timeout, unsigned int preferMs = 0);
+    void recordLatency(int backend, std::chrono::steady_clock::duration sample);
+
+    std::vector<std::unique_ptr<Backend>> backends;
+    std::atomic<int> policy;
+    std::atomic<unsigned int> nextBackend;
+    double decaySeconds;
+
+    std::mutex leaseMutex;
+    std::unordered_map<SQLConnection *, Lease> leases;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "PoolConfigWatcher.h"
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <iostream>
+
+const int PoolConfigWatcher::POLL_INTERVAL_MS;
+
+/**
+ * @brief Construct a new Pool Config Watcher:: Pool Config Watcher object
+ *
+ * @param pool the pool reconfigured on every change, must outlive the watcher.
+ * @param filename configuration file in the format read by PoolOptions::LoadFile.
+ * @param envPrefix prefix of environment variables that override the file.
+ */
+PoolConfigWatcher::PoolConfigWatcher(ConnectionPool *pool, const std::string &filename, const std::string &envPrefix)
+{
+    this->pool = pool;
+    this->filename = filename;
+    this->envPrefix = envPrefix;
+    this->inotifyFd = -1;
+    this->running = false;
+
+    size_t pos = filename.rfind('/');
+    if (pos == filename.npos)
+    {
+        directory = ".";
+        basename = filename;
+    }
+    else
+    {
+        directory = filename.substr(0, pos);
+        basename = filename.substr(pos + 1);
+    }
+}
+
+PoolConfigWatcher::~PoolConfigWatcher()
+{
+    Stop();
+}
+
+/**
+ * @brief Start watching the configuration file.
+ *
+ * The directory is watched rather than the file itself so that editors and
+ * deployment tools that replace the file by renaming are picked up too.
+ *
+ * @returns true if the watch thread was started.
+ */
+bool PoolConfigWatcher::Start()
+{
+    if (running)
+        return true;
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+    {
+        std::cerr << "Cannot watch " << filename << ": inotify_init1 failed." << std::endl;
+        return false;
+    }
+    if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        std::cerr << "Cannot watch " << filename << ": inotify_add_watch failed." << std::endl;
+        close(inotifyFd);
+        inotifyFd = -1;
+        return false;
+    }
+
+    running = true;
+    watchThread = std::thread(&PoolConfigWatcher::watchLoop, this);
+    return true;
+}
+
+void PoolConfigWatcher::Stop()
+{
+    running = false;
+    if (watchThread.joinable())
+        watchThread.join();
+    if (inotifyFd >= 0)
+    {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+}
+
+/**
+ * @brief Read the file and environment again and apply them to the pool.
+ *
+ * @returns true if the configuration was valid and applied.
+ */
+bool PoolConfigWatcher::Reload()
+{
+    PoolOptions options;
+    std::string error;
+    if (!options.LoadFile(filename, error))
+    {
+        std::cerr << "Pool configuration not reloaded: " << error << std::endl;
+        return false;
+    }
+    options.LoadEnv(envPrefix);
+
+    try
+    {
+        pool->Reconfigure(options);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Pool configuration not reloaded: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void PoolConfigWatcher::watchLoop()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    while (running)
+    {
+        struct pollfd pfd = {inotifyFd, POLLIN, 0};
+        if (poll(&pfd, 1, POLL_INTERVAL_MS) <= 0)
+            continue;
+
+        bool changed = false;
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *ptr = buffer; ptr < buffer + length;)
+            {
+                struct inotify_event *event = (struct inotify_event *)ptr;
+                if (event->len > 0 && basename == event->name)
+                    changed = true;
+                ptr += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        if (changed)
+            Reload();
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef POOL_CONFIG_WATCHER_H__ // #include guards
+#define POOL_CONFIG_WATCHER_H__
+
+/* reloads a pool configuration file whenever it changes on disk (linux only) */
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "ConnectionPool.h"
+
+class PoolConfigWatcher
+{
+public:
+    PoolConfigWatcher(
+        ConnectionPool *pool, const std::string &filename,
+        const std::string &envPrefix = "MYSQLPOOL_");
+
+    ~PoolConfigWatcher();
+
+    static const int POLL_INTERVAL_MS = 500;
+
+    bool Start();
+    void Stop();
+    bool Reload();
+
+private:
+    void watchLoop();
+
+    ConnectionPool *pool;
+    std::string filename;
+    std::string directory;
+    std::string basename;
+    std::string envPrefix;
+    int inotifyFd;
+    std::atomic<bool> running;
+    std::thread watchThread;
+};
+
+#endif
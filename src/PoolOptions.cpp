@@ -0,0 +1,207 @@
+#include "PoolOptions.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cctype>
+#include <stdexcept>
+
+/**
+ * @brief Set one option from its configuration file name.
+ *
+ * @param key option name, e.g. dbhost, port or connections.
+ * @param value option value as written in the file.
+ * @param error set when the key is unknown or the value does not parse.
+ *
+ * @returns true if the option was applied.
+ */
+bool PoolOptions::Set(const std::string &key, const std::string &value, std::string &error)
+{
+    try
+    {
+        if (key == "dbhost" || key == "server")
+            server = value;
+        else if (key == "port")
+            port = std::stoi(value);
+        else if (key == "user")
+            user = value;
+        else if (key == "password")
+            password = value;
+        else if (key == "database")
+            database = value;
+        else if (key == "connections")
+            numConnection = std::stoi(value);
+        else if (key == "max_connections")
+            maxConnections = std::stoi(value);
+        else if (key == "partitions")
+        {
+            // name:min:max entries separated by commas
+            std::vector<PoolPartition> parsed;
+            std::istringstream entries(value);
+            std::string entry;
+            while (std::getline(entries, entry, ','))
+            {
+                size_t first = entry.find(':');
+                size_t second = entry.find(':', first + 1);
+                if (first == 0 || first == std::string::npos || second == std::string::npos)
+                    throw std::invalid_argument(entry);
+                PoolPartition partition;
+                partition.name = entry.substr(0, first);
+                partition.minConnections = std::stoi(entry.substr(first + 1, second - first - 1));
+                partition.maxConnections = std::stoi(entry.substr(second + 1));
+                parsed.push_back(partition);
+            }
+            partitions = parsed;
+        }
+        else if (key == "shards")
+            shards = std::stoi(value);
+        else if (key == "numa")
+            numaAware = value == "1" || value == "true";
+        else if (key == "max_lifetime")
+            maxLifetime = std::stoul(value);
+        else if (key == "max_lease")
+            maxLease = std::stoul(value);
+        else if (key == "connect_timeout")
+            connectTimeout = std::stoul(value);
+        else if (key == "read_timeout")
+            readTimeout = std::stoul(value);
+        else if (key == "write_timeout")
+            writeTimeout = std::stoul(value);
+        else if (key == "acquire_timeout")
+            acquireTimeout = std::stoul(value);
+        else if (key == "connect_retries")
+            connectRetries = std::stoi(value);
+        else if (key == "retry_delay_ms")
+            retryDelayMs = std::stoul(value);
+        else if (key == "retry_budget_ratio")
+            retryBudgetRatio = std::stod(value);
+        else if (key == "retry_budget_min_per_second")
+            retryBudgetMinPerSecond = std::stod(value);
+        else if (key == "ssl_mode")
+            sslMode = value;
+        else if (key == "ssl_ca")
+            sslCa = value;
+        else if (key == "ssl_cert")
+            sslCert = value;
+        else if (key == "ssl_key")
+            sslKey = value;
+        else if (key == "read_only")
+            readOnly = value == "1" || value == "true";
+        else if (key == "verbose")
+            verbose = value == "1" || value == "true";
+        else if (key == "sizing_interval")
+            sizingInterval = std::stoul(value);
+        else if (key == "sizing_percentile")
+            sizingPercentile = std::stod(value);
+        else if (key == "sizing_max_wait_ms")
+            sizingMaxWaitMs = std::stoul(value);
+        else
+        {
+            error = "Unknown pool option " + key;
+            return false;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        error = "Invalid value for pool option " + key + ": " + value;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read options from a file of "name value" lines.
+ *
+ * Lines containing # are skipped, as are keys the pool does not know about,
+ * so the same file can hold application settings.
+ *
+ * @param filename path of the configuration file.
+ * @param error set when the file cannot be read or a value does not parse.
+ *
+ * @returns true if the file was read.
+ */
+bool PoolOptions::LoadFile(const std::string &filename, std::string &error)
+{
+    std::ifstream stream(filename);
+    if (!stream.is_open())
+    {
+        error = filename + " does not exist.";
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        if (line.length() == 0 || line.find('#') != line.npos)
+            continue;
+        std::stringstream ss(line);
+        std::string name;
+        std::string value;
+        ss >> name;
+        ss >> value;
+
+        std::string keyError;
+        if (!Set(name, value, keyError) && keyError.find("Unknown") != 0)
+        {
+            error = keyError;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Override options from environment variables.
+ *
+ * Each option is read from prefix followed by its upper-cased name, e.g.
+ * MYSQLPOOL_DBHOST or MYSQLPOOL_CONNECTIONS. Invalid values are reported
+ * and ignored.
+ *
+ * @param prefix prefix of the environment variable names.
+ */
+void PoolOptions::LoadEnv(const std::string &prefix)
+{
+    static const char *keys[] = {
+        "dbhost", "port", "user", "password", "database", "connections",
+        "max_connections", "partitions", "shards", "numa", "max_lifetime",
+        "max_lease", "connect_timeout", "read_timeout", "write_timeout",
+        "acquire_timeout", "connect_retries", "retry_delay_ms", "retry_budget_ratio",
+        "retry_budget_min_per_second", "ssl_mode", "ssl_ca", "ssl_cert",
+        "ssl_key", "read_only", "verbose", "sizing_interval",
+        "sizing_percentile", "sizing_max_wait_ms"};
+
+    for (const char *key : keys)
+    {
+        std::string name = prefix;
+        for (const char *c = key; *c; c++)
+            name += (char)std::toupper((unsigned char)*c);
+
+        const char *value = std::getenv(name.c_str());
+        if (value == nullptr)
+            continue;
+
+        std::string error;
+        if (!Set(key, value, error))
+            std::cerr << error << std::endl;
+    }
+}
+
+/**
+ * @brief Check whether connections opened with other would match these options.
+ *
+ * @returns false when the server, credentials, timeouts, TLS or session
+ * settings differ.
+ */
+bool PoolOptions::SameConnectionSettings(const PoolOptions &other) const
+{
+    return server == other.server && port == other.port &&
+           user == other.user && password == other.password &&
+           database == other.database &&
+           connectTimeout == other.connectTimeout &&
+           readTimeout == other.readTimeout &&
+           writeTimeout == other.writeTimeout &&
+           sslMode == other.sslMode && sslCa == other.sslCa &&
+           sslCert == other.sslCert && sslKey == other.sslKey &&
+           readOnly == other.readOnly;
+}
@@ -0,0 +1,82 @@
+#ifndef POOL_OPTIONS_H__ // #include guards
+#define POOL_OPTIONS_H__
+
+#include <string>
+#include <vector>
+
+/* settings shared by ConnectionPool and the SQLConnection objects it opens */
+
+/* a workload class with its own share of the pool's connections */
+struct PoolPartition
+{
+    std::string name;
+    int minConnections = 0; // reserved, lent to other partitions while unused
+    int maxConnections = 0; // most connections leased at once, 0 for no limit
+};
+
+struct PoolOptions
+{
+    // server and credentials
+    std::string server;
+    int port = 3306;
+    std::string user;
+    std::string password;
+    std::string database;
+
+    // sizing, maxConnections caps how far Reconfigure can grow the pool
+    int numConnection = 3;
+    int maxConnections = 64;
+    unsigned int maxLifetime = 0;
+    // seconds a lease may be held before the pool takes the connection back, 0 for no limit
+    unsigned int maxLease = 0;
+    // bulkheads selected by name in GetConnecion, e.g. "interactive:4:0,batch:0:8"
+    // in a configuration file; fixed when the pool is created
+    std::vector<PoolPartition> partitions;
+
+    // free list shards, threads take connections from their CPU's shard first;
+    // 1 keeps a single shared list, -1 uses one shard per CPU
+    int shards = 1;
+    // one shard per NUMA node instead, with each connection opened on its
+    // shard's node; needs a build with libnuma, overrides shards
+    bool numaAware = false;
+
+    // timeouts, in seconds, 0 keeps the client library default
+    unsigned int connectTimeout = 0;
+    unsigned int readTimeout = 0;
+    unsigned int writeTimeout = 0;
+    unsigned int acquireTimeout = 0;
+
+    // retry policy
+    int connectRetries = 2;
+    unsigned int retryDelayMs = 1000;
+    // retries allowed per successful request, plus a floor per second,
+    // shared by all connections of a pool
+    double retryBudgetRatio = 0.1;
+    double retryBudgetMinPerSecond = 1.0;
+
+    // TLS, sslMode is one of DISABLED, PREFERRED, REQUIRED, VERIFY_CA, VERIFY_IDENTITY
+    std::string sslMode;
+    std::string sslCa;
+    std::string sslCert;
+    std::string sslKey;
+
+    // routing
+    bool readOnly = false;
+
+    // instrumentation
+    bool verbose = true;
+    // the sizing advisor recommends, every sizingInterval seconds, the
+    // smallest pool for which sizingPercentile of the requests wait at most
+    // sizingMaxWaitMs for a connection; 0 turns it off
+    unsigned int sizingInterval = 60;
+    double sizingPercentile = 0.99;
+    unsigned int sizingMaxWaitMs = 10;
+
+    bool Set(const std::string &key, const std::string &value, std::string &error);
+    bool LoadFile(const std::string &filename, std::string &error);
+    void LoadEnv(const std::string &prefix = "MYSQLPOOL_");
+
+    bool SameConnectionSettings(const PoolOptions &other) const;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "PoolSizing.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+
+const int LeaseWindow::WAIT_BUCKETS;
+
+/**
+ * @brief Estimate a wait percentile from the bucket counts.
+ *
+ * @returns upper bound of the bucket holding the percentile, in milliseconds.
+ */
+double LeaseWindow::WaitPercentile(double percentile) const
+{
+    unsigned long long total = 0;
+    for (int i = 0; i < WAIT_BUCKETS; i++)
+        total += waits[i];
+    if (total == 0)
+        return 0;
+
+    unsigned long long rank = (unsigned long long)std::ceil(percentile * total);
+    unsigned long long seen = 0;
+    for (int i = 0; i < WAIT_BUCKETS; i++)
+    {
+        seen += waits[i];
+        if (seen >= rank && seen > 0)
+            return i == 0 ? 0 : std::ldexp(1.0, i) / 1000.0;
+    }
+    return std::ldexp(1.0, WAIT_BUCKETS - 1) / 1000.0;
+}
+
+LeaseStats::LeaseStats()
+    : acquires(0), timeouts(0), releases(0), holdNanos(0)
+{
+    for (int i = 0; i < LeaseWindow::WAIT_BUCKETS; i++)
+        waits[i].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Allocate the counters on a cache line boundary.
+ */
+void *LeaseStats::operator new(size_t size)
+{
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, alignof(LeaseStats), size) != 0)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void LeaseStats::operator delete(void *ptr)
+{
+    free(ptr);
+}
+
+void LeaseStats::RecordAcquire(long long waitNanos)
+{
+    unsigned long long micros = waitNanos > 0 ? (unsigned long long)waitNanos / 1000 : 0;
+    int bucket = micros == 0 ? 0 : 64 - __builtin_clzll(micros);
+    bucket = std::min(bucket, LeaseWindow::WAIT_BUCKETS - 1);
+    acquires.fetch_add(1, std::memory_order_relaxed);
+    waits[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LeaseStats::RecordTimeout()
+{
+    timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LeaseStats::RecordRelease(long long holdNanos)
+{
+    releases.fetch_add(1, std::memory_order_relaxed);
+    this->holdNanos.fetch_add(holdNanos > 0 ? holdNanos : 0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Add the counters to window and start them over.
+ */
+void LeaseStats::Collect(LeaseWindow &window)
+{
+    window.acquires += acquires.exchange(0, std::memory_order_relaxed);
+    window.timeouts += timeouts.exchange(0, std::memory_order_relaxed);
+    window.releases += releases.exchange(0, std::memory_order_relaxed);
+    window.holdNanos += holdNanos.exchange(0, std::memory_order_relaxed);
+    for (int i = 0; i < LeaseWindow::WAIT_BUCKETS; i++)
+        window.waits[i] += waits[i].exchange(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Smallest pool that keeps acquire waits within a bound.
+ *
+ * Little's law gives the connections busy on average, arrivalRate times
+ * the mean hold time. The pool is then sized as an M/M/c queue: Erlang C
+ * gives the chance that a request waits at all, and that chance decays
+ * exponentially with the wait, so c is raised until a request waits
+ * longer than maxWaitSeconds at most 1 - percentile of the time.
+ *
+ * @param arrivalRate lease requests per second.
+ * @param meanHoldSeconds mean lease duration.
+ * @param percentile share of requests that must get a connection in time, e.g. 0.99.
+ * @param maxWaitSeconds acceptable acquire wait at that percentile.
+ *
+ * @returns the recommended number of connections, at least 1.
+ */
+int RecommendPoolSize(double arrivalRate, double meanHoldSeconds,
+                      double percentile, double maxWaitSeconds)
+{
+    double load = arrivalRate * meanHoldSeconds;
+    if (!(load > 0))
+        return 1;
+
+    double allowed = 1.0 - std::min(std::max(percentile, 0.0), 1.0);
+    double erlangB = 1.0;
+    int limit = (int)std::ceil(load + 10 * std::sqrt(load)) + 100;
+    for (int c = 1; c < limit; c++)
+    {
+        erlangB = load * erlangB / (c + load * erlangB);
+        if (c <= load)
+            continue;
+        double erlangC = c * erlangB / (c - load * (1 - erlangB));
+        double waitBeyond = erlangC * std::exp(-(c - load) * maxWaitSeconds / meanHoldSeconds);
+        if (waitBeyond <= allowed)
+            return c;
+    }
+    return limit;
+}
@@ -0,0 +1,72 @@
+#ifndef POOL_SIZING_H__ // #include guards
+#define POOL_SIZING_H__
+
+/* lease measurements and the pool size they call for */
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+struct PoolMetrics
+{
+    // current state
+    int size = 0;
+    int leased = 0;
+    int idle = 0;
+
+    // over the last sizing interval
+    double intervalSeconds = 0;
+    unsigned long long acquires = 0;
+    unsigned long long timeouts = 0;
+    double arrivalRate = 0;      // lease requests per second, timeouts included
+    double meanHoldMs = 0;       // how long a lease was held on average
+    double offeredLoad = 0;      // arrivalRate * mean hold, connections busy on average
+    double waitPercentileMs = 0; // acquire wait at PoolOptions::sizingPercentile
+    int recommendedSize = 0;     // 0 until the first interval ends
+};
+
+/* counts of one sizing interval, summed over the shards */
+struct LeaseWindow
+{
+    static const int WAIT_BUCKETS = 32; // bucket k counts waits below 2^k microseconds
+
+    unsigned long long acquires = 0;
+    unsigned long long timeouts = 0;
+    unsigned long long releases = 0;
+    unsigned long long holdNanos = 0;
+    unsigned long long waits[WAIT_BUCKETS] = {};
+
+    double WaitPercentile(double percentile) const;
+};
+
+int RecommendPoolSize(double arrivalRate, double meanHoldSeconds,
+                      double percentile, double maxWaitSeconds);
+
+/**
+ * Lease counters of one free list shard. Updated with relaxed atomics on
+ * the acquire and release paths, collected by the maintenance thread.
+ * Aligned to a cache line so shards do not share one; allocated through
+ * its own operator new, as plain new ignores the alignment before C++17.
+ */
+class LeaseStats
+{
+public:
+    LeaseStats();
+
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
+    void RecordAcquire(long long waitNanos);
+    void RecordTimeout();
+    void RecordRelease(long long holdNanos);
+    void Collect(LeaseWindow &window);
+
+private:
+    alignas(64) std::atomic<unsigned long long> acquires;
+    std::atomic<unsigned long long> timeouts;
+    std::atomic<unsigned long long> releases;
+    std::atomic<unsigned long long> holdNanos;
+    std::atomic<unsigned long long> waits[LeaseWindow::WAIT_BUCKETS];
+};
+
+#endif
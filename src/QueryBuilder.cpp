@@ -0,0 +1,163 @@
+#include "QueryBuilder.h"
+
+#include <cstdio>
+#include <cstring>
+
+/**
+ * @brief Construct a new Query Builder:: Query Builder object
+ *
+ * Clears the connection's query buffer, keeping its capacity.
+ *
+ * @param sqlPtr connection the query is built for and run on.
+ */
+QueryBuilder::QueryBuilder(SQLConnection *sqlPtr)
+    : sqlPtr(sqlPtr), buffer(sqlPtr->queryBuffer()), failed(false)
+{
+    buffer.clear();
+}
+
+/**
+ * @brief Appends raw SQL, never pass user input here.
+ */
+QueryBuilder &QueryBuilder::append(const char *sql)
+{
+    buffer.append(sql);
+    return *this;
+}
+
+QueryBuilder &QueryBuilder::append(const std::string &sql)
+{
+    buffer.append(sql);
+    return *this;
+}
+
+/**
+ * @brief Appends a quoted and escaped string literal.
+ *
+ * @param data value, may contain NUL bytes.
+ * @param length number of bytes in data.
+ */
+QueryBuilder &QueryBuilder::value(const char *data, size_t length)
+{
+    buffer.push_back('\'');
+    if (!sqlPtr->appendEscaped(buffer, data, length, '\''))
+        failed = true;
+    buffer.push_back('\'');
+    return *this;
+}
+
+QueryBuilder &QueryBuilder::value(const std::string &data)
+{
+    return value(data.data(), data.size());
+}
+
+QueryBuilder &QueryBuilder::value(int number)
+{
+    return value((long long)number);
+}
+
+QueryBuilder &QueryBuilder::value(long long number)
+{
+    char text[24];
+    int length = snprintf(text, sizeof(text), "%lld", number);
+    buffer.append(text, length);
+    return *this;
+}
+
+QueryBuilder &QueryBuilder::value(unsigned long long number)
+{
+    char text[24];
+    int length = snprintf(text, sizeof(text), "%llu", number);
+    buffer.append(text, length);
+    return *this;
+}
+
+/**
+ * @brief Appends a number with enough digits to read back the same double.
+ */
+QueryBuilder &QueryBuilder::value(double number)
+{
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%.17g", number);
+    buffer.append(text, length);
+    return *this;
+}
+
+QueryBuilder &QueryBuilder::null()
+{
+    buffer.append("NULL", 4);
+    return *this;
+}
+
+/**
+ * @brief Appends a backtick quoted table or column name.
+ *
+ * Backticks inside the name are doubled, dots are kept as part of the name.
+ */
+QueryBuilder &QueryBuilder::identifier(const std::string &name)
+{
+    buffer.push_back('`');
+    for (char c : name)
+    {
+        if (c == '`')
+            buffer.push_back('`');
+        buffer.push_back(c);
+    }
+    buffer.push_back('`');
+    return *this;
+}
+
+const std::string &QueryBuilder::str() const
+{
+    return buffer;
+}
+
+/**
+ * @brief Starts a new query on the same buffer.
+ */
+void QueryBuilder::reset()
+{
+    buffer.clear();
+    failed = false;
+}
+
+/**
+ * @brief Runs the query, see SQLConnection::checkQuery.
+ *
+ * @param error set if a value could not be escaped or the query failed.
+ */
+bool QueryBuilder::execute(std::string &error)
+{
+    if (failed)
+    {
+        error = "ERROR: Could not escape query values, connection is closed.";
+        return false;
+    }
+    return sqlPtr->checkQuery(buffer, error);
+}
+
+/**
+ * @brief Runs the query, see SQLConnection::infoQuery.
+ */
+std::vector<std::string> QueryBuilder::info(std::string &error)
+{
+    if (failed)
+    {
+        error = "ERROR: Could not escape query values, connection is closed.";
+        return std::vector<std::string>();
+    }
+    return sqlPtr->infoQuery(buffer, error);
+}
+
+/**
+ * @brief Runs the query, see SQLConnection::selectQuery.
+ */
+std::vector<std::vector<std::string>> QueryBuilder::select(std::string &error)
+{
+    if (failed)
+    {
+        error = "ERROR: Could not escape query values, connection is closed.";
+        return std::vector<std::vector<std::string>>();
+    }
+    return sqlPtr->selectQuery(buffer, error);
+}
@@ -0,0 +1,52 @@
+#ifndef QUERY_BUILDER_H__ // #include guards
+#define QUERY_BUILDER_H__
+
+#include <string>
+#include <vector>
+
+#include "SQLConnection.h"
+
+/**
+ * Builds dynamic SQL in the connection's reusable query buffer.
+ *
+ * Values are escaped straight into the buffer with the connection's
+ * character set and the query is sent with its known length, so building
+ * and running a query does not allocate once the buffer has grown to fit.
+ * Only one builder may be in use per connection at a time.
+ *
+ *     QueryBuilder query(sqlPtr);
+ *     query.append("SELECT * FROM ").identifier(table)
+ *          .append(" WHERE name=").value(name);
+ *     auto rows = query.select(error);
+ */
+class QueryBuilder
+{
+public:
+    explicit QueryBuilder(SQLConnection *sqlPtr);
+
+    QueryBuilder &append(const char *sql);
+    QueryBuilder &append(const std::string &sql);
+
+    QueryBuilder &value(const char *data, size_t length);
+    QueryBuilder &value(const std::string &data);
+    QueryBuilder &value(int number);
+    QueryBuilder &value(long long number);
+    QueryBuilder &value(unsigned long long number);
+    QueryBuilder &value(double number);
+    QueryBuilder &null();
+    QueryBuilder &identifier(const std::string &name);
+
+    const std::string &str() const;
+    void reset();
+
+    bool execute(std::string &error);
+    std::vector<std::string> info(std::string &error);
+    std::vector<std::vector<std::string>> select(std::string &error);
+
+private:
+    SQLConnection *sqlPtr;
+    std::string &buffer;
+    bool failed;
+};
+
+#endif
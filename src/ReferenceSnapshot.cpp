@@ -0,0 +1,525 @@
+#include "ReferenceSnapshot.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+#include <iostream>
+
+#include "QueryBuilder.h"
+
+const unsigned int ReferenceSnapshot::DEFAULT_REFRESH_SECONDS;
+const unsigned int ReferenceSnapshot::PINNED_SNAPSHOTS;
+
+// unique across instances, so a pinned image is never mistaken for one of
+// another snapshot allocated at the same address
+static std::atomic<uint64_t> nextVersion(1);
+
+/*
+ * File layout, native endian:
+ *   SnapshotHeader
+ *   data: for each row the key bytes, then per field a uint32 length
+ *         (NULL_LENGTH for NULL) followed by the field bytes
+ *   index: header.rows SnapshotEntry records sorted by key, 8-byte aligned
+ */
+static const char SNAPSHOT_MAGIC[8] = {'M', 'P', 'S', 'N', 'A', 'P', '1', '\0'};
+static const uint32_t NULL_LENGTH = 0xffffffffu;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint64_t rows;
+    uint64_t fields;
+    uint64_t indexOffset;
+    uint64_t fileSize;
+    uint64_t createdAt; // unix time
+};
+
+struct SnapshotEntry
+{
+    uint64_t keyOffset;
+    uint64_t keyLength;
+    uint64_t rowOffset;
+};
+
+struct ReferenceSnapshot::Image
+{
+    void *base = MAP_FAILED;
+    size_t size = 0;
+    const SnapshotHeader *header = nullptr;
+    const SnapshotEntry *entries = nullptr;
+
+    ~Image()
+    {
+        if (base != MAP_FAILED)
+            munmap(base, size);
+    }
+
+    const char *at(uint64_t offset) const
+    {
+        return (const char *)base + offset;
+    }
+};
+
+SnapshotRow::SnapshotRow()
+    : row(nullptr), count(0)
+{
+}
+
+bool SnapshotRow::found() const
+{
+    return image != nullptr;
+}
+
+unsigned int SnapshotRow::fields() const
+{
+    return count;
+}
+
+bool SnapshotRow::isNull(unsigned int i) const
+{
+    uint32_t length;
+    return fieldAt(i, length) == nullptr;
+}
+
+const char *SnapshotRow::data(unsigned int i) const
+{
+    uint32_t length;
+    return fieldAt(i, length);
+}
+
+size_t SnapshotRow::length(unsigned int i) const
+{
+    uint32_t length;
+    fieldAt(i, length);
+    return length;
+}
+
+/**
+ * @brief Copy of field i, "NULL" for SQL NULL like SQLConnection::selectQuery.
+ */
+std::string SnapshotRow::field(unsigned int i) const
+{
+    uint32_t length;
+    const char *value = fieldAt(i, length);
+    if (value == nullptr)
+        return "NULL";
+    return std::string(value, length);
+}
+
+/**
+ * @brief Walk the row's length-prefixed fields up to field i.
+ *
+ * @returns the field's bytes, nullptr with length 0 for NULL.
+ */
+const char *SnapshotRow::fieldAt(unsigned int i, uint32_t &length) const
+{
+    const char *field = row;
+    for (unsigned int skipped = 0;; skipped++)
+    {
+        memcpy(&length, field, sizeof(length));
+        field += sizeof(length);
+        if (skipped == i)
+            break;
+        if (length != NULL_LENGTH)
+            field += length;
+    }
+    if (length == NULL_LENGTH)
+    {
+        length = 0;
+        return nullptr;
+    }
+    return field;
+}
+
+/**
+ * @brief Construct a new Reference Snapshot:: Reference Snapshot object
+ *
+ * @param pool pool refreshes lease a connection from.
+ * @param table table name, may be qualified as database.table.
+ * @param keyColumn unique column lookups are made by.
+ * @param columns select list kept for each key, raw SQL.
+ * @param path snapshot file, replaced on every refresh.
+ * @param refreshSeconds interval between refreshes, 0 only refreshes on request.
+ */
+ReferenceSnapshot::ReferenceSnapshot(
+    ConnectionPool *pool, const std::string &table,
+    const std::string &keyColumn, const std::string &columns,
+    const std::string &path, unsigned int refreshSeconds)
+{
+    this->pool = pool;
+    this->table = table;
+    this->keyColumn = keyColumn;
+    this->columns = columns;
+    this->path = path;
+    this->refreshSeconds = refreshSeconds;
+    this->running = false;
+    this->refreshRequested = false;
+    this->version = 0;
+}
+
+ReferenceSnapshot::~ReferenceSnapshot()
+{
+    Stop();
+}
+
+/**
+ * @brief Map the existing snapshot file if there is one, otherwise load the
+ * table now, then start refreshing in the background.
+ *
+ * @returns true if lookups can be served.
+ */
+bool ReferenceSnapshot::Start(std::string &error)
+{
+    std::shared_ptr<const Image> image = mapFile(path, error);
+    if (image)
+        publish(image);
+    else if (!Refresh(error))
+        return false;
+    error.clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running)
+    {
+        running = true;
+        // a mapped file may be stale, bring it up to date straight away
+        refreshRequested = image != nullptr;
+        refreshThread = std::thread(&ReferenceSnapshot::refreshLoop, this);
+    }
+    return true;
+}
+
+void ReferenceSnapshot::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeup.notify_one();
+    if (refreshThread.joinable())
+        refreshThread.join();
+}
+
+/**
+ * @brief Ask the background thread to refresh now, e.g. on a change
+ * notification for the table.
+ */
+void ReferenceSnapshot::RequestRefresh()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        refreshRequested = true;
+    }
+    wakeup.notify_one();
+}
+
+void ReferenceSnapshot::refreshLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        auto ready = [this]() { return !running || refreshRequested; };
+        if (refreshSeconds > 0)
+            wakeup.wait_for(lock, std::chrono::seconds(refreshSeconds), ready);
+        else
+            wakeup.wait(lock, ready);
+        if (!running)
+            break;
+        refreshRequested = false;
+
+        lock.unlock();
+        std::string error;
+        if (!Refresh(error))
+            std::cerr << "Snapshot refresh of " << table << " failed: " << error << std::endl;
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Reload the table, replace the file and publish the new mapping.
+ *
+ * On failure the previous snapshot stays in use.
+ */
+bool ReferenceSnapshot::Refresh(std::string &error)
+{
+    std::lock_guard<std::mutex> refreshLock(refreshMutex);
+
+    SQLConnection *sqlPtr = pool->GetConnecion();
+    if (sqlPtr == nullptr)
+    {
+        error = "ERROR: No connection available for snapshot refresh.";
+        return false;
+    }
+
+    std::string data(sizeof(SnapshotHeader), '\0');
+    std::vector<SnapshotEntry> entries;
+    uint64_t fields = 0;
+
+    QueryBuilder query(sqlPtr);
+    query.append("SELECT ").identifier(keyColumn).append(", ").append(columns)
+        .append(" FROM ").append(table);
+    bool loaded = sqlPtr->streamQuery(query.str(), [&](const RowView &row) {
+        if (row.fields == 0 || row.values[0] == nullptr)
+            return true;
+        fields = row.fields - 1;
+
+        SnapshotEntry entry;
+        entry.keyOffset = data.size();
+        entry.keyLength = row.lengths[0];
+        data.append(row.values[0], row.lengths[0]);
+        entry.rowOffset = data.size();
+        for (unsigned int i = 1; i < row.fields; i++)
+        {
+            uint32_t length = row.values[i] ? (uint32_t)row.lengths[i] : NULL_LENGTH;
+            data.append((const char *)&length, sizeof(length));
+            if (row.values[i])
+                data.append(row.values[i], row.lengths[i]);
+        }
+        entries.push_back(entry);
+        return true;
+    }, error, true);
+    pool->ReleaseConnecion(sqlPtr);
+    if (!loaded)
+        return false;
+
+    const char *base = data.data();
+    auto keyLess = [base](const SnapshotEntry &a, const SnapshotEntry &b) {
+        int order = memcmp(base + a.keyOffset, base + b.keyOffset, std::min(a.keyLength, b.keyLength));
+        return order < 0 || (order == 0 && a.keyLength < b.keyLength);
+    };
+    std::stable_sort(entries.begin(), entries.end(), keyLess);
+    // keys are meant to be unique, keep the first row of any duplicate
+    auto keyEqual = [&keyLess](const SnapshotEntry &a, const SnapshotEntry &b) {
+        return !keyLess(a, b) && !keyLess(b, a);
+    };
+    entries.erase(std::unique(entries.begin(), entries.end(), keyEqual), entries.end());
+
+    data.resize((data.size() + 7) & ~(size_t)7, '\0');
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.rows = entries.size();
+    header.fields = fields;
+    header.indexOffset = data.size();
+    header.fileSize = data.size() + entries.size() * sizeof(SnapshotEntry);
+    header.createdAt = (uint64_t)time(nullptr);
+    data.append((const char *)entries.data(), entries.size() * sizeof(SnapshotEntry));
+    memcpy(&data[0], &header, sizeof(header));
+
+    if (!writeFile(data, error))
+        return false;
+    std::shared_ptr<const Image> image = mapFile(path, error);
+    if (!image)
+        return false;
+    publish(image);
+    return true;
+}
+
+/**
+ * @brief Make image the current snapshot for every reader.
+ */
+void ReferenceSnapshot::publish(std::shared_ptr<const Image> image)
+{
+    std::atomic_store(&current, image);
+    version.store(nextVersion.fetch_add(1, std::memory_order_relaxed), std::memory_order_release);
+}
+
+/**
+ * @brief Current snapshot as pinned by the calling thread.
+ *
+ * The per-thread copy is only refreshed with std::atomic_load, which locks,
+ * once the snapshot was replaced; other lookups read one atomic.
+ */
+const std::shared_ptr<const ReferenceSnapshot::Image> &ReferenceSnapshot::pinned()
+{
+    struct Pin
+    {
+        const ReferenceSnapshot *owner = nullptr;
+        uint64_t version = 0;
+        std::shared_ptr<const Image> image;
+    };
+    static thread_local Pin pins[PINNED_SNAPSHOTS];
+
+    Pin &pin = pins[std::hash<const void *>()(this) % PINNED_SNAPSHOTS];
+    uint64_t latest = version.load(std::memory_order_acquire);
+    if (pin.owner != this || pin.version != latest)
+    {
+        pin.image = std::atomic_load(&current);
+        pin.owner = this;
+        pin.version = latest;
+    }
+    return pin.image;
+}
+
+/**
+ * @brief Write the image next to the snapshot file and rename it over it,
+ * so readers of the old mapping and restarted processes never see a
+ * partial file.
+ */
+bool ReferenceSnapshot::writeFile(const std::string &data, std::string &error)
+{
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        error = "ERROR: Cannot create " + temporary + ": " + strerror(errno);
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            error = "ERROR: Cannot write " + temporary + ": " + strerror(errno);
+            close(fd);
+            unlink(temporary.c_str());
+            return false;
+        }
+        written += n;
+    }
+    if (fsync(fd) != 0 || close(fd) != 0)
+    {
+        error = "ERROR: Cannot sync " + temporary + ": " + strerror(errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        error = "ERROR: Cannot replace " + path + ": " + strerror(errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Map a snapshot file read-only and check its layout.
+ *
+ * @returns the mapping, nullptr if the file is missing or not a valid snapshot.
+ */
+std::shared_ptr<const ReferenceSnapshot::Image> ReferenceSnapshot::mapFile(const std::string &path, std::string &error)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error = "ERROR: Cannot open " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader))
+    {
+        error = "ERROR: " + path + " is not a snapshot file.";
+        close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image = std::make_shared<Image>();
+    image->size = st.st_size;
+    image->base = mmap(nullptr, image->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image->base == MAP_FAILED)
+    {
+        error = "ERROR: Cannot map " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+
+    const SnapshotHeader *header = (const SnapshotHeader *)image->base;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->fileSize != image->size ||
+        header->indexOffset % 8 != 0 || header->indexOffset > image->size ||
+        header->rows > (image->size - header->indexOffset) / sizeof(SnapshotEntry))
+    {
+        error = "ERROR: " + path + " is not a valid snapshot file.";
+        return nullptr;
+    }
+    image->header = header;
+    image->entries = (const SnapshotEntry *)image->at(header->indexOffset);
+
+    // every key and field has to lie in the data area, lookups trust it
+    uint64_t dataEnd = header->indexOffset;
+    for (uint64_t i = 0; i < header->rows; i++)
+    {
+        const SnapshotEntry &entry = image->entries[i];
+        bool valid = entry.keyOffset <= dataEnd && entry.keyLength <= dataEnd - entry.keyOffset;
+        uint64_t offset = entry.rowOffset;
+        for (uint64_t f = 0; valid && f < header->fields; f++)
+        {
+            uint32_t length;
+            valid = offset <= dataEnd && sizeof(length) <= dataEnd - offset;
+            if (!valid)
+                break;
+            memcpy(&length, image->at(offset), sizeof(length));
+            offset += sizeof(length);
+            if (length != NULL_LENGTH)
+            {
+                valid = length <= dataEnd - offset;
+                offset += length;
+            }
+        }
+        if (!valid)
+        {
+            error = "ERROR: " + path + " is not a valid snapshot file.";
+            return nullptr;
+        }
+    }
+    return image;
+}
+
+/**
+ * @brief Find the row of a key in the current snapshot, without copying it.
+ */
+SnapshotRow ReferenceSnapshot::Find(const std::string &key)
+{
+    SnapshotRow row;
+    const std::shared_ptr<const Image> &image = pinned();
+    if (!image)
+        return row;
+
+    const SnapshotEntry *begin = image->entries;
+    const SnapshotEntry *end = begin + image->header->rows;
+    const SnapshotEntry *found = std::lower_bound(begin, end, key,
+        [&image](const SnapshotEntry &entry, const std::string &key) {
+            int order = memcmp(image->at(entry.keyOffset), key.data(), std::min<size_t>(entry.keyLength, key.size()));
+            return order < 0 || (order == 0 && entry.keyLength < key.size());
+        });
+    if (found == end || found->keyLength != key.size() ||
+        memcmp(image->at(found->keyOffset), key.data(), key.size()) != 0)
+        return row;
+
+    row.row = image->at(found->rowOffset);
+    row.count = (unsigned int)image->header->fields;
+    row.image = image;
+    return row;
+}
+
+/**
+ * @brief Copy the row of a key, NULL fields as "NULL".
+ *
+ * @returns false if the key is not in the snapshot.
+ */
+bool ReferenceSnapshot::Lookup(const std::string &key, std::vector<std::string> &row)
+{
+    SnapshotRow found = Find(key);
+    row.clear();
+    if (!found.found())
+        return false;
+    for (unsigned int i = 0; i < found.fields(); i++)
+        row.push_back(found.field(i));
+    return true;
+}
+
+/**
+ * @brief Number of keys in the current snapshot.
+ */
+size_t ReferenceSnapshot::Size()
+{
+    const std::shared_ptr<const Image> &image = pinned();
+    return image ? image->header->rows : 0;
+}
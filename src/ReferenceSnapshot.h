@@ -0,0 +1,113 @@
+#ifndef REFERENCE_SNAPSHOT_H__ // #include guards
+#define REFERENCE_SNAPSHOT_H__
+
+/* read-only, memory-mapped copy of a small table, indexed by key */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "ConnectionPool.h"
+
+class ReferenceSnapshot;
+
+/**
+ * A row found in a snapshot. It keeps its snapshot mapped, so it stays
+ * valid across refreshes until it is destroyed.
+ */
+class SnapshotRow
+{
+public:
+    SnapshotRow();
+
+    bool found() const;
+    unsigned int fields() const;
+    bool isNull(unsigned int i) const;
+    const char *data(unsigned int i) const;
+    size_t length(unsigned int i) const;
+    std::string field(unsigned int i) const;
+
+private:
+    friend class ReferenceSnapshot;
+
+    const char *fieldAt(unsigned int i, uint32_t &length) const;
+
+    std::shared_ptr<const void> image;
+    const char *row;    // first field of the row in the mapping
+    unsigned int count; // fields of the row
+};
+
+/**
+ * Loads `SELECT key, columns FROM table` through the pool into a file,
+ * maps it read-only and answers lookups from memory with a binary search
+ * over the sorted keys. A background thread rebuilds the file every
+ * refreshSeconds, or sooner after RequestRefresh(), and swaps the new
+ * mapping in atomically; readers never wait for a refresh.
+ *
+ * Each thread pins the mapping it last read and only reloads it after a
+ * refresh, so lookups take no lock. A pinned mapping stays mapped until
+ * that thread next reads a snapshot, even after a refresh replaced it.
+ *
+ * The file is replaced by rename, so a restarted process maps the last
+ * snapshot right away and serves from it while the first refresh runs.
+ * The file format is native-endian and only meant for the host that wrote it.
+ */
+class ReferenceSnapshot
+{
+public:
+    ReferenceSnapshot(
+        ConnectionPool *pool, const std::string &table,
+        const std::string &keyColumn, const std::string &columns,
+        const std::string &path, unsigned int refreshSeconds = DEFAULT_REFRESH_SECONDS);
+
+    ~ReferenceSnapshot();
+
+    static const unsigned int DEFAULT_REFRESH_SECONDS = 60;
+    static const unsigned int PINNED_SNAPSHOTS = 8; // per thread
+
+    bool Start(std::string &error);
+    void Stop();
+    bool Refresh(std::string &error);
+    void RequestRefresh();
+
+    SnapshotRow Find(const std::string &key);
+    bool Lookup(const std::string &key, std::vector<std::string> &row);
+    size_t Size();
+
+private:
+    struct Image;
+
+    static std::shared_ptr<const Image> mapFile(const std::string &path, std::string &error);
+    bool writeFile(const std::string &data, std::string &error);
+    void publish(std::shared_ptr<const Image> image);
+    const std::shared_ptr<const Image> &pinned();
+    void refreshLoop();
+
+    ConnectionPool *pool;
+    std::string table;
+    std::string keyColumn;
+    std::string columns;
+    std::string path;
+    unsigned int refreshSeconds;
+
+    // replaced with std::atomic_store, then version changes; readers only
+    // std::atomic_load it again when they see a new version
+    std::shared_ptr<const Image> current;
+    std::atomic<uint64_t> version;
+
+    // guarded by mutex
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool running;
+    bool refreshRequested;
+
+    std::mutex refreshMutex; // one rebuild at a time
+    std::thread refreshThread;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "RetryBudget.h"
+
+#include <chrono>
+#include <algorithm>
+
+constexpr double RetryBudget::DEFAULT_RATIO;
+constexpr double RetryBudget::DEFAULT_MIN_PER_SECOND;
+constexpr double RetryBudget::DEFAULT_MAX_BALANCE;
+const long long RetryBudget::SCALE;
+
+static long long nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Construct a new Retry Budget:: Retry Budget object
+ *
+ * The bucket starts full so that startup can retry.
+ *
+ * @param ratio tokens deposited per success, 0.1 allows one retry per ten successes.
+ * @param minPerSecond tokens added per second regardless of successes.
+ * @param maxBalance most tokens the bucket holds, the largest retry burst.
+ */
+RetryBudget::RetryBudget(double ratio, double minPerSecond, double maxBalance)
+{
+    this->perSuccess = (long long)(std::max(ratio, 0.0) * SCALE);
+    this->perSecond = (long long)(std::max(minPerSecond, 0.0) * SCALE);
+    this->maxBalance = (long long)(std::max(maxBalance, 1.0) * SCALE);
+    this->balance = this->maxBalance;
+    this->lastRefill = nowNanos();
+    this->allowed = 0;
+    this->denied = 0;
+}
+
+/**
+ * @brief Change the refill rates, keeping the tokens already in the bucket.
+ */
+void RetryBudget::SetRates(double ratio, double minPerSecond)
+{
+    refill();
+    perSuccess.store((long long)(std::max(ratio, 0.0) * SCALE), std::memory_order_relaxed);
+    perSecond.store((long long)(std::max(minPerSecond, 0.0) * SCALE), std::memory_order_relaxed);
+}
+
+void RetryBudget::RecordSuccess()
+{
+    long long amount = perSuccess.load(std::memory_order_relaxed);
+    if (amount > 0)
+        deposit(amount);
+}
+
+/**
+ * @brief Take a token for one retry.
+ *
+ * @returns false if the budget is spent and the caller should not retry.
+ */
+bool RetryBudget::TryRetry()
+{
+    refill();
+    long long current = balance.load(std::memory_order_relaxed);
+    while (current >= SCALE)
+    {
+        if (balance.compare_exchange_weak(current, current - SCALE, std::memory_order_relaxed))
+        {
+            allowed.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    denied.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+double RetryBudget::Balance()
+{
+    refill();
+    return (double)balance.load(std::memory_order_relaxed) / SCALE;
+}
+
+unsigned long long RetryBudget::RetriesAllowed()
+{
+    return allowed.load(std::memory_order_relaxed);
+}
+
+unsigned long long RetryBudget::RetriesDenied()
+{
+    return denied.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Add the time-based tokens since the last refill; whoever moves
+ * lastRefill forward deposits them, so they are counted once.
+ */
+void RetryBudget::refill()
+{
+    long long rate = perSecond.load(std::memory_order_relaxed);
+    long long now = nowNanos();
+    long long last = lastRefill.load(std::memory_order_relaxed);
+    if (rate <= 0)
+    {
+        // nothing accrues while the rate is 0, should it be raised later
+        lastRefill.compare_exchange_strong(last, now, std::memory_order_relaxed);
+        return;
+    }
+    long long amount = (now - last) / 1000000 * rate / 1000; // via milliseconds, no overflow
+    if (amount <= 0)
+        return;
+    if (lastRefill.compare_exchange_strong(last, now, std::memory_order_relaxed))
+        deposit(amount);
+}
+
+void RetryBudget::deposit(long long amount)
+{
+    long long current = balance.load(std::memory_order_relaxed);
+    while (current < maxBalance &&
+           !balance.compare_exchange_weak(current, std::min(maxBalance, current + amount), std::memory_order_relaxed))
+    {
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef RETRY_BUDGET_H__ // #include guards
+#define RETRY_BUDGET_H__
+
+/* limits retries to a fraction of successful requests */
+
+#include <atomic>
+
+/**
+ * Token bucket shared by everything that retries against one database.
+ *
+ * Each success deposits ratio tokens and the bucket also refills at
+ * minPerSecond tokens per second, so a few retries are possible while
+ * nothing succeeds. A retry takes one token; with an empty bucket the
+ * retry is skipped and the error returned, so clients do not multiply
+ * the load on a database that is already failing. Lock-free.
+ */
+class RetryBudget
+{
+public:
+    explicit RetryBudget(
+        double ratio = DEFAULT_RATIO,
+        double minPerSecond = DEFAULT_MIN_PER_SECOND,
+        double maxBalance = DEFAULT_MAX_BALANCE);
+
+    static constexpr double DEFAULT_RATIO = 0.1;
+    static constexpr double DEFAULT_MIN_PER_SECOND = 1.0;
+    static constexpr double DEFAULT_MAX_BALANCE = 10.0;
+
+    void SetRates(double ratio, double minPerSecond);
+    void RecordSuccess();
+    bool TryRetry();
+    double Balance();
+    unsigned long long RetriesAllowed();
+    unsigned long long RetriesDenied();
+
+private:
+    static const long long SCALE = 1000; // tokens are stored in thousandths
+
+    void refill();
+    void deposit(long long amount);
+
+    std::atomic<long long> perSuccess;
+    std::atomic<long long> perSecond;
+    long long maxBalance;
+    std::atomic<long long> balance;
+    std::atomic<long long> lastRefill; // steady_clock nanoseconds
+    std::atomic<unsigned long long> allowed;
+    std::atomic<unsigned long long> denied;
+};
+
+#endif
@@ -0,0 +1,300 @@
+#include "RowWriter.h"
+
+#include <cstdint>
+#include <cstring>
+
+const size_t RowWriter::DEFAULT_BUFFER_SIZE;
+
+/*
+ * SWAR scanning: eight bytes are tested per step with plain 64-bit
+ * arithmetic. In each mask only the lowest set high bit is exact (borrows
+ * can set bits above it), which is all that is needed to find the first
+ * byte that has to be escaped.
+ */
+static const uint64_t ONES = 0x0101010101010101ULL;
+static const uint64_t HIGHS = 0x8080808080808080ULL;
+
+static inline uint64_t load8(const char *data)
+{
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+// high bit set in each byte equal to c
+static inline uint64_t bytesEqual(uint64_t word, unsigned char c)
+{
+    uint64_t x = word ^ (ONES * c);
+    return (x - ONES) & ~x & HIGHS;
+}
+
+// high bit set in each byte below n, n <= 128
+static inline uint64_t bytesBelow(uint64_t word, unsigned char n)
+{
+    return (word - ONES * n) & ~word & HIGHS;
+}
+
+static inline size_t firstByte(uint64_t mask)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_clzll(mask) / 8;
+#else
+    return __builtin_ctzll(mask) / 8;
+#endif
+}
+
+static bool isNumeric(enum_field_types type)
+{
+    switch (type)
+    {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_NEWDECIMAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Construct a new Row Writer:: Row Writer object
+ *
+ * @param sink receives the output whenever bufferSize bytes are pending.
+ * @param bufferSize flush threshold.
+ */
+RowWriter::RowWriter(const OutputSink &sink, size_t bufferSize)
+{
+    this->sink = sink;
+    this->bufferSize = bufferSize > 0 ? bufferSize : 1;
+    this->rows = 0;
+    this->failed = false;
+    buffer.reserve(this->bufferSize + 1024);
+}
+
+/**
+ * @brief Flushes what is left, call Flush() first to see whether it worked.
+ */
+RowWriter::~RowWriter()
+{
+    Flush();
+}
+
+/**
+ * @brief Serialize one row.
+ *
+ * @returns false once the sink has refused output.
+ */
+bool RowWriter::WriteRow(const RowView &row)
+{
+    if (failed)
+        return false;
+    writeRow(row);
+    rows++;
+    if (buffer.size() >= bufferSize)
+        return Flush();
+    return true;
+}
+
+/**
+ * @brief Hand everything buffered to the sink.
+ */
+bool RowWriter::Flush()
+{
+    if (failed)
+        return false;
+    if (!buffer.empty())
+    {
+        failed = !sink(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    return !failed;
+}
+
+/**
+ * @brief Run a query and write its whole result.
+ *
+ * @param stored read the result with mysql_store_result instead of
+ * streaming it, see SQLConnection::streamQuery.
+ *
+ * @returns true if the query ran and every row reached the sink.
+ */
+bool RowWriter::Export(SQLConnection *sqlPtr, const std::string &query, std::string &error, bool stored)
+{
+    if (!sqlPtr->streamQuery(query, Handler(), error, stored))
+        return false;
+    if (!Flush())
+    {
+        error = "ERROR: Output sink refused data.";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Callback for SQLConnection::streamQuery that writes every row.
+ */
+RowHandler RowWriter::Handler()
+{
+    return [this](const RowView &row) { return WriteRow(row); };
+}
+
+unsigned long long RowWriter::RowsWritten()
+{
+    return rows;
+}
+
+CsvWriter::CsvWriter(const OutputSink &sink, bool header, char delimiter)
+    : RowWriter(sink)
+{
+    this->header = header;
+    this->delimiter = delimiter;
+}
+
+void CsvWriter::writeRow(const RowView &row)
+{
+    if (header && rows == 0 && row.columns)
+    {
+        for (unsigned int i = 0; i < row.fields; i++)
+        {
+            if (i > 0)
+                buffer.push_back(delimiter);
+            writeField(row.columns[i].name, strlen(row.columns[i].name));
+        }
+        buffer.append("\r\n", 2);
+    }
+
+    for (unsigned int i = 0; i < row.fields; i++)
+    {
+        if (i > 0)
+            buffer.push_back(delimiter);
+        if (row.values[i] == nullptr)
+            continue;
+        if (row.lengths[i] == 0)
+            buffer.append("\"\"", 2);
+        else
+            writeField(row.values[i], row.lengths[i]);
+    }
+    buffer.append("\r\n", 2);
+}
+
+void CsvWriter::writeField(const char *data, size_t length)
+{
+    // look for any byte that forces quoting
+    size_t pos = 0;
+    bool quote = false;
+    for (; pos + 8 <= length && !quote; pos += 8)
+    {
+        uint64_t word = load8(data + pos);
+        quote = (bytesEqual(word, '"') | bytesEqual(word, (unsigned char)delimiter) |
+                 bytesEqual(word, '\n') | bytesEqual(word, '\r')) != 0;
+    }
+    for (; pos < length && !quote; pos++)
+    {
+        char c = data[pos];
+        quote = c == '"' || c == delimiter || c == '\n' || c == '\r';
+    }
+
+    if (!quote)
+    {
+        buffer.append(data, length);
+        return;
+    }
+
+    buffer.push_back('"');
+    const char *end = data + length;
+    while (data < end)
+    {
+        const char *found = (const char *)memchr(data, '"', end - data);
+        if (found == nullptr)
+        {
+            buffer.append(data, end - data);
+            break;
+        }
+        buffer.append(data, found - data + 1);
+        buffer.push_back('"');
+        data = found + 1;
+    }
+    buffer.push_back('"');
+}
+
+NdjsonWriter::NdjsonWriter(const OutputSink &sink)
+    : RowWriter(sink)
+{
+}
+
+void NdjsonWriter::writeRow(const RowView &row)
+{
+    buffer.push_back('{');
+    for (unsigned int i = 0; i < row.fields; i++)
+    {
+        if (i > 0)
+            buffer.push_back(',');
+        const char *name = row.columns ? row.columns[i].name : "";
+        writeString(name, strlen(name));
+        buffer.push_back(':');
+        if (row.values[i] == nullptr)
+            buffer.append("null", 4);
+        else if (row.columns && isNumeric(row.columns[i].type) && row.lengths[i] > 0)
+            buffer.append(row.values[i], row.lengths[i]);
+        else
+            writeString(row.values[i], row.lengths[i]);
+    }
+    buffer.append("}\n", 2);
+}
+
+void NdjsonWriter::writeString(const char *data, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    buffer.push_back('"');
+    size_t start = 0;
+    size_t pos = 0;
+    while (pos < length)
+    {
+        // skip eight clean bytes at a time
+        if (pos + 8 <= length)
+        {
+            uint64_t word = load8(data + pos);
+            uint64_t mask = bytesEqual(word, '"') | bytesEqual(word, '\\') | bytesBelow(word, 0x20);
+            if (mask == 0)
+            {
+                pos += 8;
+                continue;
+            }
+            pos += firstByte(mask);
+        }
+        else
+        {
+            unsigned char c = (unsigned char)data[pos];
+            if (c != '"' && c != '\\' && c >= 0x20)
+            {
+                pos++;
+                continue;
+            }
+        }
+
+        buffer.append(data + start, pos - start);
+        unsigned char c = (unsigned char)data[pos];
+        switch (c)
+        {
+        case '"': buffer.append("\\\"", 2); break;
+        case '\\': buffer.append("\\\\", 2); break;
+        case '\n': buffer.append("\\n", 2); break;
+        case '\r': buffer.append("\\r", 2); break;
+        case '\t': buffer.append("\\t", 2); break;
+        default:
+            buffer.append("\\u00", 4);
+            buffer.push_back(hex[c >> 4]);
+            buffer.push_back(hex[c & 0xf]);
+        }
+        start = ++pos;
+    }
+    buffer.append(data + start, length - start);
+    buffer.push_back('"');
+}
@@ -0,0 +1,83 @@
+#ifndef ROW_WRITER_H__ // #include guards
+#define ROW_WRITER_H__
+
+/* serializes result rows straight from the client library's row buffers */
+
+#include <string>
+#include <functional>
+
+#include "SQLConnection.h"
+
+/* receives serialized output in chunks; return false to stop writing */
+typedef std::function<bool(const char *data, size_t length)> OutputSink;
+
+/**
+ * Formats RowViews into an internal buffer that is handed to the sink
+ * whenever it fills, so no per-row or per-field strings are built.
+ * Use Handler() with SQLConnection::streamQuery or Export() to write a
+ * whole result.
+ */
+class RowWriter
+{
+public:
+    explicit RowWriter(const OutputSink &sink, size_t bufferSize = DEFAULT_BUFFER_SIZE);
+    virtual ~RowWriter();
+
+    static const size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+    bool WriteRow(const RowView &row);
+    bool Flush();
+    bool Export(SQLConnection *sqlPtr, const std::string &query, std::string &error, bool stored = false);
+    RowHandler Handler();
+    unsigned long long RowsWritten();
+
+protected:
+    virtual void writeRow(const RowView &row) = 0;
+
+    std::string buffer;
+    unsigned long long rows;
+
+private:
+    OutputSink sink;
+    size_t bufferSize;
+    bool failed;
+};
+
+/**
+ * RFC 4180 CSV. Fields containing the delimiter, a quote or a line break
+ * are quoted with inner quotes doubled; NULL is written as an empty field
+ * and an empty string as "".
+ */
+class CsvWriter : public RowWriter
+{
+public:
+    CsvWriter(const OutputSink &sink, bool header = true, char delimiter = ',');
+
+protected:
+    void writeRow(const RowView &row) override;
+
+private:
+    void writeField(const char *data, size_t length);
+
+    bool header;
+    char delimiter;
+};
+
+/**
+ * One JSON object per line, keyed by column name. Numeric columns are
+ * written as JSON numbers, NULL as null and everything else as strings.
+ * Bytes are copied as they are, so binary columns can produce invalid UTF-8.
+ */
+class NdjsonWriter : public RowWriter
+{
+public:
+    explicit NdjsonWriter(const OutputSink &sink);
+
+protected:
+    void writeRow(const RowView &row) override;
+
+private:
+    void writeString(const char *data, size_t length);
+};
+
+#endif
@@ -0,0 +1,895 @@
+#include "SQLConnection.h"
+
+#include <iostream>
+#include <thread>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <mysqld_error.h>
+#include <errmsg.h>
+
+const unsigned long SQLConnection::FETCH_BUFFER_SIZE;
+
+SQLConnection::SQLConnection(
+	const std::string& server, int port, const std::string& user, 
+	const std::string& password, const std::string& database, int id) 
+{
+	this->options.server = server;
+	this->options.user = user;
+	this->options.password = password;
+	this->options.database = database;
+	this->options.port = port;
+	this->index = id;
+	conn = nullptr;
+	result = nullptr;
+	threadId = 0;
+	revoked = false;
+}
+
+SQLConnection::SQLConnection(const PoolOptions& options, int id,
+	std::shared_ptr<RetryBudget> retryBudget)
+{
+	this->options = options;
+	this->index = id;
+	this->retryBudget = retryBudget;
+	conn = nullptr;
+	result = nullptr;
+	threadId = 0;
+	revoked = false;
+}
+
+SQLConnection::~SQLConnection()
+{
+	close();
+}
+
+/**
+ * @brief Opens the connection, retrying on failure.
+ *
+ * @param retry number of attempts, -1 to use the connectRetries option.
+ *
+ * @returns true once connected.
+ */
+bool SQLConnection::connect(int retry)
+{
+	bool success = false;
+	if (retry < 0)
+		retry = options.connectRetries;
+	if(retry <= 0 )
+	{
+		std::cout << "Failed to connect to host=" << options.server 
+				<< " db=" << options.database << " user=" << options.user << std::endl;
+		return false;
+	}
+
+	MYSQL* handle = mysql_init(NULL);
+	unsigned int localInfile = 0;
+	mysql_options(handle, MYSQL_OPT_LOCAL_INFILE, &localInfile);
+	if (options.connectTimeout > 0)
+		mysql_options(handle, MYSQL_OPT_CONNECT_TIMEOUT, &options.connectTimeout);
+	if (options.readTimeout > 0)
+		mysql_options(handle, MYSQL_OPT_READ_TIMEOUT, &options.readTimeout);
+	if (options.writeTimeout > 0)
+		mysql_options(handle, MYSQL_OPT_WRITE_TIMEOUT, &options.writeTimeout);
+	if (!options.sslMode.empty())
+	{
+		unsigned int mode = SSL_MODE_PREFERRED;
+		if (options.sslMode == "DISABLED")
+			mode = SSL_MODE_DISABLED;
+		else if (options.sslMode == "REQUIRED")
+			mode = SSL_MODE_REQUIRED;
+		else if (options.sslMode == "VERIFY_CA")
+			mode = SSL_MODE_VERIFY_CA;
+		else if (options.sslMode == "VERIFY_IDENTITY")
+			mode = SSL_MODE_VERIFY_IDENTITY;
+		mysql_options(handle, MYSQL_OPT_SSL_MODE, &mode);
+	}
+	if (!options.sslCa.empty())
+		mysql_options(handle, MYSQL_OPT_SSL_CA, options.sslCa.c_str());
+	if (!options.sslCert.empty())
+		mysql_options(handle, MYSQL_OPT_SSL_CERT, options.sslCert.c_str());
+	if (!options.sslKey.empty())
+		mysql_options(handle, MYSQL_OPT_SSL_KEY, options.sslKey.c_str());
+	if (options.readOnly)
+		mysql_options(handle, MYSQL_INIT_COMMAND, "SET SESSION TRANSACTION READ ONLY");
+
+	conn = mysql_real_connect(
+			handle, options.server.c_str(), options.user.c_str(), 
+			options.password.c_str(), options.database.c_str(), options.port, 
+			NULL, CLIENT_MULTI_STATEMENTS);
+
+	if (conn != nullptr)
+	{
+		success = true;
+		threadId = mysql_thread_id(conn);
+		if (retryBudget)
+			retryBudget->RecordSuccess();
+	}
+	else if (retry > 1 && retryBudget && !retryBudget->TryRetry())
+	{
+		// still wait, so a caller looping on connect is slowed down too
+		mysql_close(handle);
+		std::cerr << "Not retrying connect to host=" << options.server
+				<< ", retry budget exhausted." << std::endl;
+		std::this_thread::sleep_for(std::chrono::milliseconds(options.retryDelayMs));
+	}
+	else
+	{
+		mysql_close(handle);
+		//cout << ". . Trying to reconnect after 1 second . ." << endl;
+		if (retry > 1)
+			std::this_thread::sleep_for(std::chrono::milliseconds(options.retryDelayMs));
+		success = connect(retry - 1);
+	}
+	return success;
+}
+
+bool SQLConnection::close()
+{
+	bool success = false;
+	for (auto& statement : statements)
+		mysql_stmt_close(statement.second.statement);
+	statements.clear();
+
+	if (conn)
+	{
+		mysql_close(conn);
+		conn = nullptr;
+		threadId = 0;
+		success = true;
+	}
+	return success;
+}
+
+bool SQLConnection::isValide()
+{
+	return conn != nullptr;
+}
+
+
+bool SQLConnection::checkQuery(const std::string& query, std::string& error)
+{
+	if (rejectRevoked(error))
+		return false;
+	if (isValide())
+	{
+		int code = realQuery(query);
+		if (code != 0)
+		{
+			error = std::string(mysql_error(conn));
+			return false;
+		}
+
+		while(mysql_more_results(conn))
+			mysql_next_result(conn);
+
+		if (retryBudget)
+			retryBudget->RecordSuccess();
+		return true;
+	}
+	error = "ERROR: DB connection is not available !";
+	return false;
+}
+
+
+std::vector<std::string> SQLConnection::infoQuery(
+	const std::string& query, std::string& error)
+{
+	std::vector<std::string> rows;
+	if (rejectRevoked(error))
+		return rows;
+    if(conn)
+    {
+        int code = realQuery(query);
+        if(code != 0)
+			error = mysql_error(conn);
+        else
+        {
+            MYSQL_ROW row;
+            MYSQL_RES * result = mysql_store_result(conn);
+            if(result)
+            {
+                while (((row=mysql_fetch_row(result)) !=NULL))
+                {
+                    rows.push_back(row[0]);
+                }
+                mysql_free_result(result);
+            }
+            if (retryBudget)
+                retryBudget->RecordSuccess();
+        }
+    }
+    else
+        error = "ERROR: DB connection is not available !";
+    return std::move(rows);
+}
+
+std::vector<std::vector<std::string>> SQLConnection::selectQuery(
+	const std::string& query, std::string& error)
+{
+    std::vector<std::vector<std::string>> rows;
+	if (rejectRevoked(error))
+		return rows;
+
+    if(conn)
+    {
+        int code = realQuery(query);
+        if(code != 0)
+			error = mysql_error(conn);
+        else
+        {
+            MYSQL_ROW row;
+            MYSQL_RES * result = mysql_store_result(conn);
+            if(result)
+            {
+                int numFields = (int)mysql_num_fields(result);
+                while((row = mysql_fetch_row(result)))
+                {
+                    unsigned long* lengths = mysql_fetch_lengths(result);
+                    std::vector <std::string> temp;
+                    temp.reserve(numFields);
+                    for (int i=0 ; i < numFields; i++)
+                    {
+                        if(row[i]==NULL)
+                            temp.push_back("NULL");
+                        else
+                            temp.emplace_back(row[i], lengths[i]);
+                    }
+                    if(!temp.empty())
+                        rows.push_back(std::move(temp));
+                }
+                mysql_free_result(result);
+            }
+            if (retryBudget)
+                retryBudget->RecordSuccess();
+        }
+    }
+    else
+        error = "ERROR: DB connection is not available !";
+    return std::move(rows);
+}
+
+/**
+ * @brief Runs a query and hands each row to onRow as it arrives.
+ *
+ * Rows are read with mysql_use_result, so only one row is held in client
+ * memory at a time and the server waits on a slow handler. With stored,
+ * the whole result is read with mysql_store_result first, freeing the
+ * server side sooner at the cost of client memory.
+ *
+ * @param onRow called for every row, returning false skips the rest.
+ * @param error set if the query or reading the result failed.
+ * @param stored buffer the result on the client before the first callback.
+ *
+ * @returns true if the query ran and its result was read.
+ */
+bool SQLConnection::streamQuery(const std::string& query,
+	const RowHandler& onRow, std::string& error, bool stored)
+{
+	if (rejectRevoked(error))
+		return false;
+	if (!conn)
+	{
+		error = "ERROR: DB connection is not available !";
+		return false;
+	}
+	if (realQuery(query) != 0)
+	{
+		error = mysql_error(conn);
+		return false;
+	}
+
+	MYSQL_RES* result = stored ? mysql_store_result(conn) : mysql_use_result(conn);
+	if (result == nullptr)
+	{
+		if (mysql_field_count(conn) != 0)
+		{
+			error = mysql_error(conn);
+			return false;
+		}
+		return true;
+	}
+
+	RowView view;
+	view.fields = mysql_num_fields(result);
+	view.columns = mysql_fetch_fields(result);
+	while ((view.values = mysql_fetch_row(result)))
+	{
+		view.lengths = mysql_fetch_lengths(result);
+		if (!onRow(view))
+			break;
+	}
+
+	// mysql_fetch_row returns NULL on errors as well as at the end
+	bool success = view.values != nullptr || mysql_errno(conn) == 0;
+	if (!success)
+		error = mysql_error(conn);
+	else if (retryBudget)
+		retryBudget->RecordSuccess();
+	mysql_free_result(result);
+	return success;
+}
+
+/**
+ * @brief Runs an idempotent read, retrying transient failures.
+ *
+ * Deadlocks, lock wait timeouts and lost connections are retried, after
+ * reconnecting for the latter, as long as the retry budget allows.
+ *
+ * @param attempts most times the query is sent.
+ */
+std::vector<std::vector<std::string>> SQLConnection::selectWithRetry(
+	const std::string& query, std::string& error, int attempts)
+{
+	for (int attempt = 1; ; attempt++)
+	{
+		error.clear();
+		auto rows = selectQuery(query, error);
+		if (error.empty())
+			return rows;
+
+		unsigned int code = getErrorCode();
+		if (revoked || (conn && !isTransientError(code)) || attempt >= attempts)
+			return rows;
+		if (retryBudget && !retryBudget->TryRetry())
+		{
+			error += " (retry budget exhausted)";
+			return rows;
+		}
+		if (!conn || code == CR_SERVER_GONE_ERROR || code == CR_SERVER_LOST)
+		{
+			close();
+			if (!connect())
+				return rows;
+		}
+	}
+}
+
+/**
+ * @brief Runs body inside a transaction, retrying it when the transaction
+ * is rolled back by a deadlock or lock wait timeout.
+ *
+ * body may run several times and must not have effects outside the
+ * database. A retry takes a token from the retry budget.
+ *
+ * @param body statements of the transaction.
+ * @param attempts most times the transaction is run.
+ *
+ * @returns true if the transaction committed.
+ */
+bool SQLConnection::transaction(const TransactionBody& body, std::string& error,
+	int attempts)
+{
+	for (int attempt = 1; ; attempt++)
+	{
+		error.clear();
+		bool committed = checkQuery("START TRANSACTION", error) &&
+			body(this, error) && checkQuery("COMMIT", error);
+		if (committed)
+			return true;
+
+		// a closed connection is retried like a lost one, after reconnecting
+		unsigned int code = conn ? getErrorCode() : (unsigned int)CR_SERVER_GONE_ERROR;
+		std::string rollbackError;
+		if (conn)
+			checkQuery("ROLLBACK", rollbackError);
+		if (error.empty())
+			error = "ERROR: Transaction failed.";
+		if (revoked || !isTransientError(code) || attempt >= attempts)
+			return false;
+		if (retryBudget && !retryBudget->TryRetry())
+		{
+			error += " (retry budget exhausted)";
+			return false;
+		}
+		if (!conn || code == CR_SERVER_GONE_ERROR || code == CR_SERVER_LOST)
+		{
+			close();
+			if (!connect())
+				return false;
+		}
+	}
+}
+
+/**
+ * @brief Error number of the last statement, 0 if it succeeded.
+ */
+unsigned int SQLConnection::getErrorCode()
+{
+	return conn ? mysql_errno(conn) : 0;
+}
+
+/**
+ * @brief Whether an error is worth retrying: the statement may succeed if
+ * simply run again.
+ */
+bool SQLConnection::isTransientError(unsigned int code)
+{
+	return code == ER_LOCK_DEADLOCK || code == ER_LOCK_WAIT_TIMEOUT ||
+		code == CR_SERVER_GONE_ERROR || code == CR_SERVER_LOST;
+}
+
+/**
+ * @brief Share a retry budget with other connections, nullptr for unlimited.
+ */
+void SQLConnection::setRetryBudget(std::shared_ptr<RetryBudget> retryBudget)
+{
+	this->retryBudget = retryBudget;
+}
+
+std::shared_ptr<RetryBudget> SQLConnection::getRetryBudget()
+{
+	return this->retryBudget;
+}
+
+/**
+ * @brief Rewrites a query so the server enforces the caller's deadline.
+ *
+ * SELECT statements get a MAX_EXECUTION_TIME optimizer hint set to the time
+ * left until deadline; other statements are returned unchanged since the
+ * server ignores max_execution_time for them.
+ *
+ * @param query the statement to run.
+ * @param deadline point in time after which the caller no longer waits.
+ * @param error set when the deadline has already passed.
+ *
+ * @returns the rewritten query, or an empty string if no time is left.
+ */
+std::string SQLConnection::applyTimeBudget(const std::string& query,
+	std::chrono::steady_clock::time_point deadline, std::string& error)
+{
+	auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+		deadline - std::chrono::steady_clock::now()).count();
+	if (remaining <= 0)
+	{
+		error = "ERROR: Query deadline exceeded before execution.";
+		return std::string();
+	}
+
+	size_t pos = 0;
+	while (pos < query.size() && std::isspace((unsigned char)query[pos]))
+		pos++;
+
+	static const char keyword[] = "select";
+	size_t len = sizeof(keyword) - 1;
+	if (query.size() < pos + len)
+		return query;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (std::tolower((unsigned char)query[pos + i]) != keyword[i])
+			return query;
+	}
+	if (query.size() > pos + len && !std::isspace((unsigned char)query[pos + len]))
+		return query;
+
+	std::string rewritten;
+	rewritten.reserve(query.size() + 40);
+	rewritten.append(query, 0, pos + len);
+	rewritten.append(" /*+ MAX_EXECUTION_TIME(");
+	rewritten.append(std::to_string(remaining));
+	rewritten.append(") */");
+	rewritten.append(query, pos + len, std::string::npos);
+	return rewritten;
+}
+
+bool SQLConnection::checkQuery(const std::string& query, std::string& error,
+	std::chrono::steady_clock::time_point deadline)
+{
+	std::string budgeted = applyTimeBudget(query, deadline, error);
+	if (budgeted.empty())
+		return false;
+	return checkQuery(budgeted, error);
+}
+
+std::vector<std::string> SQLConnection::infoQuery(const std::string& query,
+	std::string& error, std::chrono::steady_clock::time_point deadline)
+{
+	std::string budgeted = applyTimeBudget(query, deadline, error);
+	if (budgeted.empty())
+		return std::vector<std::string>();
+	return infoQuery(budgeted, error);
+}
+
+std::vector<std::vector<std::string>> SQLConnection::selectQuery(
+	const std::string& query, std::string& error,
+	std::chrono::steady_clock::time_point deadline)
+{
+	std::string budgeted = applyTimeBudget(query, deadline, error);
+	if (budgeted.empty())
+		return std::vector<std::vector<std::string>>();
+	return selectQuery(budgeted, error);
+}
+
+/**
+ * @brief Appends a value escaped for use inside a quoted SQL literal.
+ *
+ * Escaping follows the connection's character set. The quotes themselves
+ * are not added.
+ *
+ * @param buffer string the escaped value is appended to.
+ * @param data value to escape, may contain NUL bytes.
+ * @param length number of bytes in data.
+ * @param quote quote character the literal is enclosed in.
+ *
+ * @returns false if the connection is not open.
+ */
+bool SQLConnection::appendEscaped(std::string& buffer, const char* data,
+	unsigned long length, char quote)
+{
+	if (!conn)
+		return false;
+
+	size_t start = buffer.size();
+	buffer.resize(start + 2 * length + 1);
+	unsigned long written = mysql_real_escape_string_quote(
+		conn, &buffer[start], data, length, quote);
+	buffer.resize(start + written);
+	return true;
+}
+
+/**
+ * @brief Scratch buffer for building queries, reused across calls.
+ *
+ * Only one query may be built at a time on a connection.
+ */
+std::string& SQLConnection::queryBuffer()
+{
+	return buffer;
+}
+
+/**
+ * @brief Prepares a statement on the server and keeps it for this connection.
+ *
+ * Statements stay prepared until the connection is closed. Preparing the
+ * same query twice is a no-op.
+ *
+ * @param query the statement text, with ? placeholders.
+ * @param error set to the server error when preparation fails.
+ *
+ * @returns true if the statement is prepared.
+ */
+bool SQLConnection::prepare(const std::string& query, std::string& error)
+{
+	return prepareStatement(SqlText::hashId(query.c_str()), query.c_str(),
+		query.size(), nullptr, error) != nullptr;
+}
+
+bool SQLConnection::isPrepared(const std::string& query)
+{
+	auto found = statements.find(SqlText::hashId(query.c_str()));
+	return found != statements.end() && found->second.text == query;
+}
+
+/**
+ * @brief Looks up a prepared statement by id, preparing it on a miss.
+ *
+ * The text is compared only when a different literal than last time maps
+ * to the id, so repeated calls from the same SqlTemplate cost one lookup.
+ *
+ * @param id SqlText::hashId of text.
+ * @param literal address of the SqlTemplate text, nullptr for runtime text.
+ */
+MYSQL_STMT* SQLConnection::prepareStatement(uint64_t id, const char* text,
+	size_t length, const char* literal, std::string& error)
+{
+	if (!conn)
+	{
+		error = "ERROR: DB connection is not available !";
+		return nullptr;
+	}
+
+	auto found = statements.find(id);
+	if (found != statements.end())
+	{
+		PreparedStatement& prepared = found->second;
+		if (literal == nullptr || literal != prepared.literal)
+		{
+			if (prepared.text.size() != length ||
+				prepared.text.compare(0, length, text, length) != 0)
+			{
+				error = "ERROR: Statement id collision between \"" +
+					prepared.text + "\" and \"" + std::string(text, length) + "\"";
+				return nullptr;
+			}
+			if (literal)
+				prepared.literal = literal;
+		}
+		return prepared.statement;
+	}
+
+	MYSQL_STMT* statement = mysql_stmt_init(conn);
+	if (statement == nullptr)
+	{
+		error = mysql_error(conn);
+		return nullptr;
+	}
+	if (mysql_stmt_prepare(statement, text, length) != 0)
+	{
+		error = mysql_stmt_error(statement);
+		mysql_stmt_close(statement);
+		return nullptr;
+	}
+	statements[id] = PreparedStatement{ statement, std::string(text, length), literal };
+	return statement;
+}
+
+/**
+ * @brief Runs a SqlTemplate as a prepared statement.
+ *
+ * Every result column is fetched as a string, NULL values as "NULL" like
+ * selectQuery. Calls, errors and latency are counted per fingerprint.
+ *
+ * @param values count statement arguments, in placeholder order.
+ * @param rows receives the result set, nullptr to discard it.
+ *
+ * @returns true if the statement ran.
+ */
+bool SQLConnection::runStatement(const SqlText& sql, const SqlValue* values,
+	size_t count, std::vector<std::vector<std::string>>* rows,
+	std::string& error)
+{
+	if (rejectRevoked(error))
+		return false;
+	auto start = std::chrono::steady_clock::now();
+	StatementMetrics& counters = metrics[sql.fingerprint];
+	counters.calls++;
+
+	bool success = false;
+	MYSQL_STMT* statement = prepareStatement(sql.id, sql.text, sql.length, sql.text, error);
+	if (statement)
+	{
+		std::vector<MYSQL_BIND> params(count);
+		bool isNull = true;
+		for (size_t i = 0; i < count; i++)
+		{
+			MYSQL_BIND& bind = params[i];
+			memset(&bind, 0, sizeof(bind));
+			const SqlValue& value = values[i];
+			switch (value.kind)
+			{
+			case SqlValue::SQL_NULL:
+				bind.buffer_type = MYSQL_TYPE_NULL;
+				bind.is_null = &isNull;
+				break;
+			case SqlValue::SQL_SIGNED:
+				bind.buffer_type = MYSQL_TYPE_LONGLONG;
+				bind.buffer = (void*)&value.integer;
+				break;
+			case SqlValue::SQL_UNSIGNED:
+				bind.buffer_type = MYSQL_TYPE_LONGLONG;
+				bind.buffer = (void*)&value.uinteger;
+				bind.is_unsigned = true;
+				break;
+			case SqlValue::SQL_DOUBLE:
+				bind.buffer_type = MYSQL_TYPE_DOUBLE;
+				bind.buffer = (void*)&value.real;
+				break;
+			case SqlValue::SQL_STRING:
+				bind.buffer_type = MYSQL_TYPE_STRING;
+				bind.buffer = (void*)value.data;
+				bind.buffer_length = value.length;
+				bind.length = (unsigned long*)&value.length;
+				break;
+			}
+		}
+
+		if (count > 0 && mysql_stmt_bind_param(statement, params.data()))
+			error = mysql_stmt_error(statement);
+		else
+		{
+			auto sent = std::chrono::steady_clock::now();
+			int code = mysql_stmt_execute(statement);
+			recordRoundTrip(sent, code == 0);
+			if (code != 0)
+				error = mysql_stmt_error(statement);
+			else
+				success = fetchStatement(statement, rows, error);
+		}
+		mysql_stmt_free_result(statement);
+	}
+
+	if (!success)
+		counters.errors++;
+	else if (retryBudget)
+		retryBudget->RecordSuccess();
+	unsigned long long micros = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	counters.totalMicros += micros;
+	if (micros > counters.maxMicros)
+		counters.maxMicros = micros;
+	return success;
+}
+
+/**
+ * @brief Reads an executed statement's result set as strings.
+ *
+ * Columns are first fetched into a small buffer; values that do not fit
+ * are fetched again with mysql_stmt_fetch_column at their full length.
+ */
+bool SQLConnection::fetchStatement(MYSQL_STMT* statement,
+	std::vector<std::vector<std::string>>* rows, std::string& error)
+{
+	MYSQL_RES* metadata = mysql_stmt_result_metadata(statement);
+	if (metadata == nullptr)
+		return true;
+	unsigned int numFields = mysql_num_fields(metadata);
+	mysql_free_result(metadata);
+
+	if (mysql_stmt_store_result(statement) != 0)
+	{
+		error = mysql_stmt_error(statement);
+		return false;
+	}
+	if (rows == nullptr)
+		return true;
+
+	std::vector<MYSQL_BIND> binds(numFields);
+	std::vector<std::string> buffers(numFields, std::string(FETCH_BUFFER_SIZE, '\0'));
+	std::vector<unsigned long> lengths(numFields);
+	std::unique_ptr<bool[]> nulls(new bool[numFields]);
+	std::unique_ptr<bool[]> truncated(new bool[numFields]);
+	for (unsigned int i = 0; i < numFields; i++)
+	{
+		MYSQL_BIND& bind = binds[i];
+		memset(&bind, 0, sizeof(bind));
+		bind.buffer_type = MYSQL_TYPE_STRING;
+		bind.buffer = &buffers[i][0];
+		bind.buffer_length = FETCH_BUFFER_SIZE;
+		bind.length = &lengths[i];
+		bind.is_null = &nulls[i];
+		bind.error = &truncated[i];
+	}
+	if (numFields > 0 && mysql_stmt_bind_result(statement, binds.data()))
+	{
+		error = mysql_stmt_error(statement);
+		return false;
+	}
+
+	int code;
+	while ((code = mysql_stmt_fetch(statement)) == 0 || code == MYSQL_DATA_TRUNCATED)
+	{
+		std::vector<std::string> row;
+		row.reserve(numFields);
+		for (unsigned int i = 0; i < numFields; i++)
+		{
+			if (nulls[i])
+				row.push_back("NULL");
+			else if (lengths[i] <= FETCH_BUFFER_SIZE)
+				row.emplace_back(buffers[i].data(), lengths[i]);
+			else
+			{
+				std::string value(lengths[i], '\0');
+				MYSQL_BIND column;
+				memset(&column, 0, sizeof(column));
+				column.buffer_type = MYSQL_TYPE_STRING;
+				column.buffer = &value[0];
+				column.buffer_length = lengths[i];
+				if (mysql_stmt_fetch_column(statement, &column, i, 0) != 0)
+				{
+					error = mysql_stmt_error(statement);
+					return false;
+				}
+				row.push_back(std::move(value));
+			}
+		}
+		rows->push_back(std::move(row));
+	}
+	if (code != MYSQL_NO_DATA)
+	{
+		error = mysql_stmt_error(statement);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Counters of the statements with this fingerprint run on this
+ * connection, zero if none ran.
+ */
+StatementMetrics SQLConnection::getStatementMetrics(uint64_t fingerprint)
+{
+	auto found = metrics.find(fingerprint);
+	return found != metrics.end() ? found->second : StatementMetrics();
+}
+
+const std::unordered_map<uint64_t, StatementMetrics>& SQLConnection::getStatementMetrics()
+{
+	return metrics;
+}
+
+/**
+ * @brief Counters of every query and statement execution on this connection.
+ *
+ * Only the wait for the server's answer is timed, not reading the rows or
+ * the caller's work in between, so totalMicros / calls tracks how fast the
+ * backend responds.
+ */
+StatementMetrics SQLConnection::getQueryMetrics()
+{
+	return roundTrips;
+}
+
+int SQLConnection::realQuery(const std::string& query)
+{
+	auto sent = std::chrono::steady_clock::now();
+	int code = mysql_real_query(conn, query.data(), query.size());
+	recordRoundTrip(sent, code == 0);
+	return code;
+}
+
+void SQLConnection::recordRoundTrip(std::chrono::steady_clock::time_point sent, bool success)
+{
+	unsigned long long micros = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - sent).count();
+	roundTrips.calls++;
+	if (!success)
+		roundTrips.errors++;
+	roundTrips.totalMicros += micros;
+	if (micros > roundTrips.maxMicros)
+		roundTrips.maxMicros = micros;
+}
+
+std::string SQLConnection::getServer()
+{
+	return this->options.server;
+}
+
+std::string SQLConnection::getDatabase()
+{
+	return this->options.database;
+}
+	
+std::string SQLConnection::getUser()
+{
+	return this->options.user;
+}
+
+int SQLConnection::getPoolId()
+{
+	return this->index;
+}
+
+/**
+ * @brief The client library handle, for APIs this class does not wrap.
+ *
+ * nullptr while the connection is closed. The handle is owned by this
+ * object and must not be closed by the caller.
+ */
+MYSQL* SQLConnection::getHandle()
+{
+	return this->conn;
+}
+
+/**
+ * @brief Server thread id of the connection, 0 while it is closed.
+ *
+ * Safe to call from another thread, e.g. to KILL a query running on it.
+ */
+unsigned long SQLConnection::getThreadId()
+{
+	return this->threadId;
+}
+
+/**
+ * @brief Make every later query fail without reaching the server.
+ *
+ * Called by the pool when it takes back a lease held for too long; the
+ * holder only learns about it from the errors of its next queries.
+ */
+void SQLConnection::revoke()
+{
+	this->revoked = true;
+}
+
+bool SQLConnection::isRevoked()
+{
+	return this->revoked;
+}
+
+bool SQLConnection::rejectRevoked(std::string& error)
+{
+	if (!revoked)
+		return false;
+	error = "ERROR: Connection lease was revoked by the pool.";
+	return true;
+}
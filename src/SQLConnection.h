@@ -5,11 +5,44 @@
 
 #include <mysql.h>
 #include <string>
-#include <iostream>
-#include <thread>      
 #include <chrono> 
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+#include "PoolOptions.h"
+#include "SqlTemplate.h"
+#include "RetryBudget.h"
+
+/* per-fingerprint counters for statements run from a SqlTemplate */
+struct StatementMetrics
+{
+	unsigned long long calls = 0;
+	unsigned long long errors = 0;
+	unsigned long long totalMicros = 0;
+	unsigned long long maxMicros = 0;
+};
+
+/* one row of a streamed result, only valid during the callback */
+struct RowView
+{
+	MYSQL_ROW values;        // NULL entries are SQL NULL
+	unsigned long* lengths;
+	MYSQL_FIELD* columns;
+	unsigned int fields;
+};
+
+/* return false to stop reading the result */
+typedef std::function<bool(const RowView&)> RowHandler;
+
+class SQLConnection;
 
+/* statements of one transaction; return false, with error set, to roll back */
+typedef std::function<bool(SQLConnection*, std::string&)> TransactionBody;
 
 class SQLConnection
 {
@@ -17,14 +50,18 @@ public:
 	SQLConnection(
 		const std::string& server, int port, const std::string& user, 
 		const std::string& password, const std::string& database, int id=-1); 
+	SQLConnection(const PoolOptions& options, int id=-1,
+		std::shared_ptr<RetryBudget> retryBudget=nullptr);
 
 	virtual ~SQLConnection();
 
-	bool connect(int retry=2);
+	static const unsigned long FETCH_BUFFER_SIZE = 256;
+
+	bool connect(int retry=-1);
 	bool close();
 	bool isValide();
 
-	bool checkQuery(std::string query, std::string& error);
+	bool checkQuery(const std::string& query, std::string& error);
 
 	std::vector<std::string> infoQuery(
 		const std::string& query, std::string& error);
@@ -32,196 +69,107 @@ public:
 	std::vector<std::vector<std::string>> selectQuery(
 		const std::string& query, std::string& error);
 
-	std::string getServer();
-	std::string getDatabase();
-	std::string getUser();
-	int getPoolId();
+	bool streamQuery(const std::string& query, const RowHandler& onRow,
+		std::string& error, bool stored=false);
 
-private:
-	MYSQL* conn;
-	MYSQL_RES* result;
-	MYSQL_ROW row;
-	std::string server;
-	std::string user; 
-	std::string password;
-	std::string database;
-	int port;
-	int index;
-};
+	std::vector<std::vector<std::string>> selectWithRetry(
+		const std::string& query, std::string& error, int attempts=3);
+	bool transaction(const TransactionBody& body, std::string& error,
+		int attempts=3);
 
+	unsigned int getErrorCode();
+	static bool isTransientError(unsigned int code);
+	void setRetryBudget(std::shared_ptr<RetryBudget> retryBudget);
+	std::shared_ptr<RetryBudget> getRetryBudget();
 
-SQLConnection::SQLConnection(
-	const std::string& server, int port, const std::string& user, 
-	const std::string& password, const std::string& database, int id) 
-{
-	this->server = server;
-	this->user = user;
-	this->password = password;
-	this->database = database;
-	this->port = port;
-	this->index = id;
-	conn = nullptr;
-	result = nullptr;
-}
-
-SQLConnection::~SQLConnection()
-{
-	close();
-}
+	bool checkQuery(const std::string& query, std::string& error,
+		std::chrono::steady_clock::time_point deadline);
 
-bool SQLConnection::connect(int retry)
-{
-	bool success = false;
-	if(retry <= 0 )
-	{
-		std::cout << "Failed to connect to host=" << server 
-				<< " db=" << database << " user=" << user << std::endl;
-		return false;
-	}
+	std::vector<std::string> infoQuery(const std::string& query,
+		std::string& error, std::chrono::steady_clock::time_point deadline);
 
-	conn = mysql_init(NULL);
-	mysql_options(conn, MYSQL_OPT_LOCAL_INFILE, 0);
+	std::vector<std::vector<std::string>> selectQuery(const std::string& query,
+		std::string& error, std::chrono::steady_clock::time_point deadline);
 
-	conn = mysql_real_connect(
-			conn, server.c_str(), user.c_str(), 
-			password.c_str(), database.c_str(), port, 
-			NULL, CLIENT_MULTI_STATEMENTS);
+	bool appendEscaped(std::string& buffer, const char* data,
+		unsigned long length, char quote='\'');
+	std::string& queryBuffer();
 
-	if (conn != nullptr)
-		success = true;
-	else
-	{
-		//cout << ". . Trying to reconnect after 1 second . ." << endl;
-		std::this_thread::sleep_for(std::chrono::seconds(1));
-		success = connect(retry--);
-	}
-	return success;
-}
+	bool prepare(const std::string& query, std::string& error);
+	bool isPrepared(const std::string& query);
 
-bool SQLConnection::close()
-{
-	bool success = false;
-	if (conn)
+	template <size_t N, class... Args>
+	bool checkQuery(const SqlTemplate<N>& sql, std::string& error, const Args&... args)
 	{
-		mysql_close(conn);
-		conn = nullptr;
-		success = true;
+		static_assert(sizeof...(Args) == N,
+			"number of arguments does not match the placeholders in the SQL template");
+		const SqlValue values[] = { SqlValue(args)..., SqlValue() };
+		return runStatement(sql, values, N, nullptr, error);
 	}
-	return success;
-}
 
-bool SQLConnection::isValide()
-{
-	if (conn && conn->server_status == MYSQL_STATUS_READY)
-		return true;
-	return false;
-}
-
-
-bool SQLConnection::checkQuery(std::string query, std::string& error)
-{
-	if (isValide())
+	template <size_t N, class... Args>
+	std::vector<std::vector<std::string>> selectQuery(
+		const SqlTemplate<N>& sql, std::string& error, const Args&... args)
 	{
-		int code = mysql_query(conn, query.c_str());
-		if (code != 0)
-		{
-			error = std::string(mysql_error(conn));
-			return false;
-		}
-
-		while(mysql_more_results(conn))
-			mysql_next_result(conn);
-
-		return true;
+		static_assert(sizeof...(Args) == N,
+			"number of arguments does not match the placeholders in the SQL template");
+		const SqlValue values[] = { SqlValue(args)..., SqlValue() };
+		std::vector<std::vector<std::string>> rows;
+		runStatement(sql, values, N, &rows, error);
+		return rows;
 	}
-	return false;
-}
 
+	StatementMetrics getStatementMetrics(uint64_t fingerprint);
+	const std::unordered_map<uint64_t, StatementMetrics>& getStatementMetrics();
+	StatementMetrics getQueryMetrics();
 
-std::vector<std::string> SQLConnection::infoQuery(
-	const std::string& query, std::string& error)
-{
-	std::vector<std::string> rows;
-    if(conn)
-    {
-        int code = mysql_query(conn, query.c_str());
-        if(code != 0)
-			error = mysql_error(conn);
-        else
-        {
-            MYSQL_ROW row;
-            MYSQL_RES * result = mysql_store_result(conn);
-            if(result)
-            {
-                while (((row=mysql_fetch_row(result)) !=NULL))
-                {
-                    rows.push_back(row[0]);
-                }
-                mysql_free_result(result);
-            }
-        }
-    }
-    else
-        error = "ERROR: DB connection is not available !";
-    return std::move(rows);
-}
-
-std::vector<std::vector<std::string>> SQLConnection::selectQuery(
-	const std::string& query, std::string& error)
-{
-    std::vector<std::vector<std::string>> rows;
-
-    if(conn)
-    {
-        int code = mysql_query(conn, query.c_str());
-        if(code != 0)
-			error = mysql_error(conn);
-        else
-        {
-            MYSQL_ROW row;
-            MYSQL_RES * result = mysql_store_result(conn);
-            if(result)
-            {
-                while((row = mysql_fetch_row(result)))
-                {
-                    std::vector <std::string> temp;
-                    for (int i=0 ; i < (int)mysql_num_fields(result); i++)
-                    {
-                        if(row[i]==NULL)
-                            temp.push_back("NULL");
-                        else
-                            temp.push_back(row[i]);
-                    }
-                    if(!temp.empty())
-                        rows.push_back(temp);
-                }
-                mysql_free_result(result);
-            }
-        }
-    }
-    else
-        error = "ERROR: DB connection is not available !";
-    return std::move(rows);
-}
-
-std::string SQLConnection::getServer()
-{
-	return this->server;
-}
+	static std::string applyTimeBudget(const std::string& query,
+		std::chrono::steady_clock::time_point deadline, std::string& error);
 
-std::string SQLConnection::getDatabase()
-{
-	return this->database;
-}
-	
-std::string SQLConnection::getUser()
-{
-	return this->user;
-}
+	std::string getServer();
+	std::string getDatabase();
+	std::string getUser();
+	int getPoolId();
+	MYSQL* getHandle();
+	unsigned long getThreadId();
 
-int SQLConnection::getPoolId()
-{
-	return this->index;
-}
+	void revoke();
+	bool isRevoked();
+
+private:
+	MYSQL* conn;
+	MYSQL_RES* result;
+	MYSQL_ROW row;
+	PoolOptions options;
+	int index;
+	struct PreparedStatement
+	{
+		MYSQL_STMT* statement;
+		std::string text;
+		const char* literal; // last SqlTemplate text seen with this id
+	};
+
+	MYSQL_STMT* prepareStatement(uint64_t id, const char* text,
+		size_t length, const char* literal, std::string& error);
+	bool fetchStatement(MYSQL_STMT* statement,
+		std::vector<std::vector<std::string>>* rows, std::string& error);
+	bool runStatement(const SqlText& sql, const SqlValue* values,
+		size_t count, std::vector<std::vector<std::string>>* rows,
+		std::string& error);
+	bool rejectRevoked(std::string& error);
+	int realQuery(const std::string& query);
+	void recordRoundTrip(std::chrono::steady_clock::time_point sent, bool success);
+
+	// keyed by SqlText::hashId of the statement text
+	std::unordered_map<uint64_t, PreparedStatement> statements;
+	std::unordered_map<uint64_t, StatementMetrics> metrics;
+	StatementMetrics roundTrips; // every query, see getQueryMetrics
+	std::string buffer;
+	std::shared_ptr<RetryBudget> retryBudget;
+
+	// written by the owner, read by the pool's maintenance thread
+	std::atomic<unsigned long> threadId;
+	std::atomic<bool> revoked;
+};
 
 #endif
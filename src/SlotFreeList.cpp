@@ -0,0 +1,107 @@
+#include "SlotFreeList.h"
+
+#include <cstdlib>
+
+const uint32_t SlotFreeList::EMPTY;
+
+/**
+ * @brief Construct a new Slot Free List:: Slot Free List object
+ *
+ * @param capacity number of slots, indexes pushed must be below it.
+ */
+SlotFreeList::SlotFreeList(size_t capacity)
+    : head(pack(0, EMPTY)), count(0), slots(capacity), next(new std::atomic<uint32_t>[capacity])
+{
+    for (size_t i = 0; i < capacity; i++)
+        next[i].store(EMPTY, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Allocate a list on a cache line boundary.
+ */
+void *SlotFreeList::operator new(size_t size)
+{
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, alignof(SlotFreeList), size) != 0)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void SlotFreeList::operator delete(void *ptr)
+{
+    free(ptr);
+}
+
+uint64_t SlotFreeList::pack(uint32_t tag, uint32_t slot)
+{
+    return ((uint64_t)tag << 32) | slot;
+}
+
+uint32_t SlotFreeList::slotOf(uint64_t head)
+{
+    return (uint32_t)head;
+}
+
+uint32_t SlotFreeList::tagOf(uint64_t head)
+{
+    return (uint32_t)(head >> 32);
+}
+
+/**
+ * @brief Put a slot on top of the list.
+ *
+ * @returns false if the slot is out of range.
+ */
+bool SlotFreeList::push(int slot)
+{
+    if (slot < 0 || (size_t)slot >= slots)
+        return false;
+
+    uint64_t old = head.load(std::memory_order_relaxed);
+    uint64_t updated;
+    do
+    {
+        next[slot].store(slotOf(old), std::memory_order_relaxed);
+        updated = pack(tagOf(old) + 1, (uint32_t)slot);
+    } while (!head.compare_exchange_weak(old, updated, std::memory_order_release, std::memory_order_relaxed));
+
+    count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Take the most recently pushed slot.
+ *
+ * @param slot set to the slot taken.
+ *
+ * @returns false if the list is empty.
+ */
+bool SlotFreeList::pop(int &slot)
+{
+    uint64_t old = head.load(std::memory_order_acquire);
+    uint64_t updated;
+    do
+    {
+        if (slotOf(old) == EMPTY)
+            return false;
+        // may read a link that is being rewritten, the tag check below rejects it
+        uint32_t below = next[slotOf(old)].load(std::memory_order_relaxed);
+        updated = pack(tagOf(old) + 1, below);
+    } while (!head.compare_exchange_weak(old, updated, std::memory_order_acquire, std::memory_order_acquire));
+
+    count.fetch_sub(1, std::memory_order_relaxed);
+    slot = (int)slotOf(old);
+    return true;
+}
+
+size_t SlotFreeList::sizeApprox() const
+{
+    // a pop can be counted before the push it took from
+    long approx = count.load(std::memory_order_relaxed);
+    return approx < 0 ? 0 : (size_t)approx;
+}
+
+size_t SlotFreeList::capacity() const
+{
+    return slots;
+}
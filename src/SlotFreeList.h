@@ -0,0 +1,48 @@
+#ifndef SLOT_FREE_LIST_H__ // #include guards
+#define SLOT_FREE_LIST_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+/**
+ * Bounded lock-free LIFO of slot indexes in [0, capacity).
+ *
+ * A Treiber stack whose nodes are the slots themselves: next[i] links slot i
+ * to the slot below it, and the head packs the top index with a tag that
+ * changes on every update so a stale compare-exchange cannot succeed (ABA).
+ * Each slot may be in the list at most once; the caller guarantees that.
+ *
+ * The head and count sit on cache lines of their own. Plain new does not
+ * honour that alignment before C++17, so the class allocates itself.
+ */
+class SlotFreeList
+{
+public:
+    explicit SlotFreeList(size_t capacity);
+
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
+    bool push(int slot);
+    bool pop(int &slot);
+
+    size_t sizeApprox() const;
+    size_t capacity() const;
+
+private:
+    static const uint32_t EMPTY = 0xffffffffu;
+
+    static uint64_t pack(uint32_t tag, uint32_t slot);
+    static uint32_t slotOf(uint64_t head);
+    static uint32_t tagOf(uint64_t head);
+
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<long> count;
+    size_t slots;
+    std::unique_ptr<std::atomic<uint32_t>[]> next;
+};
+
+#endif
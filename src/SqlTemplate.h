@@ -0,0 +1,188 @@
+#ifndef SQL_TEMPLATE_H__ // #include guards
+#define SQL_TEMPLATE_H__
+
+/* SQL statements whose placeholder count and hashes are computed by the compiler */
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/**
+ * C++11 constexpr folds over a statement's text.
+ *
+ * Each fold handles four characters per call so that statements of a few
+ * thousand characters stay within the compiler's constexpr depth limit.
+ * The same functions run at runtime for statements prepared from strings,
+ * so both produce the same ids.
+ */
+struct SqlText
+{
+    static constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+    static constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+    static constexpr uint64_t mix(uint64_t hash, char c)
+    {
+        return (hash ^ (unsigned char)c) * FNV_PRIME;
+    }
+
+    static constexpr bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static constexpr char lower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+    }
+
+    // FNV-1a over the exact text, identifies the prepared statement
+    struct IdStep
+    {
+        static constexpr uint64_t step(uint64_t hash, const char *s, size_t i)
+        {
+            return mix(hash, s[i]);
+        }
+    };
+
+    // FNV-1a over the text with ASCII case folded and whitespace runs
+    // collapsed, groups metrics of statements that only differ in layout
+    struct FingerprintStep
+    {
+        static constexpr uint64_t step(uint64_t hash, const char *s, size_t i)
+        {
+            return isSpace(s[i])
+                ? (i == 0 || isSpace(s[i - 1]) ? hash : mix(hash, ' '))
+                : mix(hash, lower(s[i]));
+        }
+    };
+
+    // state packs the open quote character in bits 0-7, a pending backslash
+    // escape in bit 8 and the number of ? seen outside quotes above that
+    struct PlaceholderStep
+    {
+        static constexpr uint64_t step(uint64_t state, const char *s, size_t i)
+        {
+            return (state & 0x100) ? state & ~0x100ULL
+                : (state & 0xff) ? (s[i] == '\\' && (state & 0xff) != '`' ? state | 0x100
+                    : (unsigned char)s[i] == (state & 0xff) ? state & ~0xffULL : state)
+                : (s[i] == '\'' || s[i] == '"' || s[i] == '`') ? state | (unsigned char)s[i]
+                : s[i] == '?' ? state + 0x200 : state;
+        }
+    };
+
+    template <class Step>
+    static constexpr uint64_t fold(const char *s, size_t i, uint64_t state)
+    {
+        return !s[i] ? state
+            : !s[i + 1] ? Step::step(state, s, i)
+            : !s[i + 2] ? Step::step(Step::step(state, s, i), s, i + 1)
+            : !s[i + 3] ? Step::step(Step::step(Step::step(state, s, i), s, i + 1), s, i + 2)
+            : fold<Step>(s, i + 4, Step::step(Step::step(Step::step(Step::step(
+                  state, s, i), s, i + 1), s, i + 2), s, i + 3));
+    }
+
+    static constexpr size_t checkedPlaceholders(uint64_t state)
+    {
+        return (state & 0x1ff) ? throw std::logic_error("SQL template has an unterminated quote")
+                               : (size_t)(state >> 9);
+    }
+
+    static constexpr uint64_t hashId(const char *s)
+    {
+        return fold<IdStep>(s, 0, FNV_OFFSET);
+    }
+
+    static constexpr uint64_t hashFingerprint(const char *s)
+    {
+        return fold<FingerprintStep>(s, 0, FNV_OFFSET);
+    }
+
+    static constexpr size_t countPlaceholders(const char *s)
+    {
+        return checkedPlaceholders(fold<PlaceholderStep>(s, 0, 0));
+    }
+
+    constexpr SqlText(const char *text, size_t length, uint64_t id, uint64_t fingerprint)
+        : text(text), length(length), id(id), fingerprint(fingerprint) {}
+
+    const char *text;
+    size_t length;
+    uint64_t id;
+    uint64_t fingerprint;
+};
+
+/**
+ * A statement with N ? placeholders, made with the SQL() macro.
+ *
+ * Query methods taking a SqlTemplate<N> reject calls with a different
+ * number of arguments at compile time.
+ */
+template <size_t N>
+struct SqlTemplate : SqlText
+{
+    static constexpr size_t PLACEHOLDERS = N;
+
+    constexpr SqlTemplate(const char *text, size_t length, uint64_t id, uint64_t fingerprint)
+        : SqlText(text, length, id, fingerprint) {}
+};
+
+/**
+ * A statement argument. Only the types below convert to it, so passing any
+ * other type to a templated query fails to compile. Strings are referenced,
+ * not copied, and must outlive the call.
+ */
+struct SqlValue
+{
+    enum Kind
+    {
+        SQL_NULL,
+        SQL_SIGNED,
+        SQL_UNSIGNED,
+        SQL_DOUBLE,
+        SQL_STRING
+    };
+
+    SqlValue() : kind(SQL_NULL) {}
+    SqlValue(std::nullptr_t) : kind(SQL_NULL) {}
+    SqlValue(int number) : kind(SQL_SIGNED) { integer = number; }
+    SqlValue(long number) : kind(SQL_SIGNED) { integer = number; }
+    SqlValue(long long number) : kind(SQL_SIGNED) { integer = number; }
+    SqlValue(unsigned int number) : kind(SQL_UNSIGNED) { uinteger = number; }
+    SqlValue(unsigned long number) : kind(SQL_UNSIGNED) { uinteger = number; }
+    SqlValue(unsigned long long number) : kind(SQL_UNSIGNED) { uinteger = number; }
+    SqlValue(float number) : kind(SQL_DOUBLE) { real = number; }
+    SqlValue(double number) : kind(SQL_DOUBLE) { real = number; }
+    SqlValue(const char *text)
+        : kind(text ? SQL_STRING : SQL_NULL), data(text),
+          length(text ? std::char_traits<char>::length(text) : 0) {}
+    SqlValue(const std::string &text) : kind(SQL_STRING), data(text.data()), length(text.size()) {}
+
+    Kind kind;
+    union
+    {
+        long long integer;
+        unsigned long long uinteger;
+        double real;
+    };
+    const char *data = nullptr;
+    unsigned long length = 0;
+};
+
+/**
+ * @brief Makes a SqlTemplate from a string literal.
+ *
+ * The placeholder count, statement id and fingerprint are constant
+ * expressions; an unterminated quote in the text is a compile error.
+ */
+#ifndef SQL
+#define SQL(text)                                                               \
+    SqlTemplate<std::integral_constant<                                         \
+        size_t, SqlText::countPlaceholders(text)>::value>(                      \
+        text, sizeof(text) - 1,                                                 \
+        std::integral_constant<uint64_t, SqlText::hashId(text)>::value,         \
+        std::integral_constant<uint64_t, SqlText::hashFingerprint(text)>::value)
+#endif
+
+#endif
@@ -0,0 +1,238 @@
+#include "TableExporter.h"
+
+#include <thread>
+#include <iostream>
+#include <cstdlib>
+
+#include "QueryBuilder.h"
+
+const int TableExporter::DEFAULT_WORKERS;
+const int TableExporter::DEFAULT_RANGES_PER_WORKER;
+
+/**
+ * @brief Construct a new Table Exporter:: Table Exporter object
+ *
+ * @param pool pool the workers lease their connections from.
+ * @param table table name, may be qualified as database.table.
+ * @param keyColumn integer column the table is split on, ideally the primary key.
+ * @param columns select list exported, raw SQL.
+ * @param workers connections read from in parallel.
+ * @param rangesPerWorker ranges planned per worker, more ranges even out skew.
+ */
+TableExporter::TableExporter(
+    ConnectionPool *pool, const std::string &table,
+    const std::string &keyColumn, const std::string &columns,
+    int workers, int rangesPerWorker)
+{
+    this->pool = pool;
+    this->table = table;
+    this->keyColumn = keyColumn;
+    this->columns = columns;
+    this->workers = workers > 0 ? workers : 1;
+    this->rangesPerWorker = rangesPerWorker > 0 ? rangesPerWorker : 1;
+    this->snapshotLock = false;
+    this->nextRange = 0;
+    this->aborted = false;
+}
+
+void TableExporter::SetSnapshotLock(bool enabled)
+{
+    snapshotLock = enabled;
+}
+
+/**
+ * @brief Split [MIN(key), MAX(key)] into workers * rangesPerWorker ranges.
+ *
+ * @returns the ranges, empty if the table is empty or on error.
+ */
+std::vector<ExportRange> TableExporter::PlanRanges(std::string &error)
+{
+    std::vector<ExportRange> ranges;
+    SQLConnection *sqlPtr = pool->GetConnecion();
+    if (sqlPtr == nullptr)
+    {
+        error = "ERROR: No connection available for export.";
+        return ranges;
+    }
+
+    QueryBuilder query(sqlPtr);
+    query.append("SELECT MIN(").identifier(keyColumn).append("), MAX(")
+        .identifier(keyColumn).append(") FROM ").append(table);
+    auto rows = query.select(error);
+    pool->ReleaseConnecion(sqlPtr);
+    if (!error.empty() || rows.empty() || rows[0].size() < 2 || rows[0][0] == "NULL")
+        return ranges;
+
+    char *end = nullptr;
+    long long low = std::strtoll(rows[0][0].c_str(), &end, 10);
+    if (*end != '\0')
+    {
+        error = "ERROR: Export key column " + keyColumn + " is not an integer.";
+        return ranges;
+    }
+    long long high = std::strtoll(rows[0][1].c_str(), nullptr, 10);
+
+    // unsigned arithmetic so the span of a full BIGINT range does not overflow
+    unsigned long long span = (unsigned long long)high - (unsigned long long)low + 1;
+    unsigned long long count = (unsigned long long)workers * rangesPerWorker;
+    if (span != 0 && count > span)
+        count = span;
+    unsigned long long step = span == 0 ? ~0ULL / count : span / count;
+
+    for (unsigned long long i = 0; i < count; i++)
+    {
+        ExportRange range;
+        range.index = (int)i;
+        range.low = (long long)((unsigned long long)low + i * step);
+        range.last = i + 1 == count;
+        range.high = range.last ? high : (long long)((unsigned long long)low + (i + 1) * step);
+        ranges.push_back(range);
+    }
+    return ranges;
+}
+
+/**
+ * @brief Export every range of the table to sink.
+ *
+ * @param sink receives the rows of each range in key order; it is called
+ * from several threads at once, but never concurrently for one range.
+ * @param error set to the first failure.
+ *
+ * @returns true if every range was exported and the sink never aborted.
+ */
+bool TableExporter::Export(const ExportSink &sink, std::string &error)
+{
+    std::vector<ExportRange> ranges = PlanRanges(error);
+    if (!error.empty())
+        return false;
+    if (ranges.empty())
+        return true;
+
+    std::vector<SQLConnection *> connections;
+    bool opened = openSnapshots(connections, error);
+
+    nextRange = 0;
+    aborted = !opened;
+    std::vector<std::string> errors(connections.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; opened && i < connections.size(); i++)
+        threads.emplace_back(&TableExporter::exportRanges, this, connections[i],
+                             std::cref(ranges), std::cref(sink), std::ref(errors[i]));
+    for (auto &thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        std::string commitError;
+        connections[i]->checkQuery("COMMIT", commitError);
+        pool->ReleaseConnecion(connections[i]);
+        if (error.empty() && !errors[i].empty())
+            error = errors[i];
+    }
+    if (error.empty() && aborted)
+        error = "ERROR: Export aborted by the sink.";
+    return error.empty();
+}
+
+/**
+ * @brief Lease the worker connections and open a snapshot on each.
+ *
+ * Only the first worker and the lock connection wait for the pool, both
+ * before the lock is taken. The other workers take idle connections
+ * without waiting, so fewer workers than requested are used if the pool
+ * runs out of them.
+ */
+bool TableExporter::openSnapshots(std::vector<SQLConnection *> &connections, std::string &error)
+{
+    SQLConnection *first = pool->GetConnecion();
+    if (first == nullptr)
+    {
+        error = "ERROR: No connection available for export.";
+        return false;
+    }
+    connections.push_back(first);
+
+    SQLConnection *lockPtr = nullptr;
+    if (snapshotLock)
+    {
+        lockPtr = pool->GetConnecion();
+        if (lockPtr == nullptr)
+        {
+            error = "ERROR: No connection available for the export lock.";
+            return false;
+        }
+        if (!lockPtr->checkQuery("FLUSH TABLES WITH READ LOCK", error))
+        {
+            if (error.empty())
+                error = "ERROR: Could not take the export lock.";
+            pool->ReleaseConnecion(lockPtr);
+            return false;
+        }
+    }
+
+    // every server write waits while the lock is held, so nothing below may
+    // wait for a release
+    bool opened = true;
+    for (int i = 0; i < workers && opened; i++)
+    {
+        SQLConnection *sqlPtr = i == 0 ? first : pool->TryGetConnecion();
+        if (sqlPtr == nullptr)
+            break;
+        if (i > 0)
+            connections.push_back(sqlPtr);
+
+        std::string snapshotError;
+        if (!sqlPtr->checkQuery("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ", snapshotError) ||
+            !sqlPtr->checkQuery("START TRANSACTION WITH CONSISTENT SNAPSHOT, READ ONLY", snapshotError))
+        {
+            // a worker without its snapshot would not see the same data as the others
+            opened = false;
+            if (error.empty())
+                error = snapshotError.empty() ? "ERROR: Could not open the export snapshot." : snapshotError;
+        }
+    }
+
+    if (lockPtr)
+    {
+        std::string unlockError;
+        lockPtr->checkQuery("UNLOCK TABLES", unlockError);
+        pool->ReleaseConnecion(lockPtr);
+    }
+
+    return opened;
+}
+
+/**
+ * @brief Worker loop: take the next unclaimed range until none are left.
+ */
+void TableExporter::exportRanges(SQLConnection *sqlPtr, const std::vector<ExportRange> &ranges,
+                                 const ExportSink &sink, std::string &error)
+{
+    while (!aborted)
+    {
+        size_t next = nextRange.fetch_add(1);
+        if (next >= ranges.size())
+            break;
+        const ExportRange &range = ranges[next];
+
+        QueryBuilder builder(sqlPtr);
+        builder.append("SELECT ").append(columns).append(" FROM ").append(table)
+            .append(" WHERE ").identifier(keyColumn).append(" >= ").value(range.low)
+            .append(" AND ").identifier(keyColumn).append(range.last ? " <= " : " < ").value(range.high)
+            .append(" ORDER BY ").identifier(keyColumn);
+
+        bool ok = sqlPtr->streamQuery(builder.str(), [this, &range, &sink](const RowView &row) {
+            if (aborted || !sink(range, row))
+            {
+                aborted = true;
+                return false;
+            }
+            return true;
+        }, error);
+        if (!ok)
+        {
+            std::cerr << "Export of range " << range.index << " failed: " << error << std::endl;
+            aborted = true;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef TABLE_EXPORTER_H__ // #include guards
+#define TABLE_EXPORTER_H__
+
+/* reads a table in parallel key ranges, each on its own pool connection */
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+
+#include "ConnectionPool.h"
+
+struct ExportRange
+{
+    int index;
+    long long low;  // inclusive
+    long long high; // exclusive, except for the last range
+    bool last;
+};
+
+/* called concurrently from different ranges; return false to abort the export */
+typedef std::function<bool(const ExportRange &, const RowView &)> ExportSink;
+
+/**
+ * Splits a table on an integer key into equal ranges between MIN(key) and
+ * MAX(key) and streams the ranges concurrently, one per leased connection,
+ * each inside START TRANSACTION WITH CONSISTENT SNAPSHOT.
+ *
+ * With SetSnapshotLock(true), the snapshots are opened while another
+ * connection holds FLUSH TABLES WITH READ LOCK, so every range sees the
+ * same point in time; that needs the RELOAD privilege and briefly blocks
+ * writers. Without it each range is consistent on its own. Workers after
+ * the first only take idle connections, so the lock is never held while
+ * waiting for the pool.
+ */
+class TableExporter
+{
+public:
+    TableExporter(
+        ConnectionPool *pool, const std::string &table,
+        const std::string &keyColumn, const std::string &columns = "*",
+        int workers = DEFAULT_WORKERS, int rangesPerWorker = DEFAULT_RANGES_PER_WORKER);
+
+    static const int DEFAULT_WORKERS = 4;
+    static const int DEFAULT_RANGES_PER_WORKER = 4;
+
+    void SetSnapshotLock(bool enabled);
+    std::vector<ExportRange> PlanRanges(std::string &error);
+    bool Export(const ExportSink &sink, std::string &error);
+
+private:
+    bool openSnapshots(std::vector<SQLConnection *> &connections, std::string &error);
+    void exportRanges(SQLConnection *sqlPtr, const std::vector<ExportRange> &ranges,
+                      const ExportSink &sink, std::string &error);
+
+    ConnectionPool *pool;
+    std::string table;
+    std::string keyColumn;
+    std::string columns;
+    int workers;
+    int rangesPerWorker;
+    bool snapshotLock;
+
+    std::atomic<size_t> nextRange;
+    std::atomic<bool> aborted;
+};
+
+#endif
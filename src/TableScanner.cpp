@@ -0,0 +1,146 @@
+#include "TableScanner.h"
+
+#include "QueryBuilder.h"
+
+const unsigned int TableScanner::DEFAULT_CHUNK_SIZE;
+
+/**
+ * @brief Construct a new Table Scanner:: Table Scanner object
+ *
+ * @param pool pool each chunk leases a connection from.
+ * @param table table name, may be qualified as database.table.
+ * @param keyColumns columns of a unique key without NULLs, most significant first.
+ * @param columns select list returned for each row, raw SQL.
+ * A bare "*" is qualified with the table, as it cannot follow the key.
+ * @param chunkSize most rows fetched per query.
+ */
+TableScanner::TableScanner(
+    ConnectionPool *pool, const std::string &table,
+    const std::vector<std::string> &keyColumns,
+    const std::string &columns, unsigned int chunkSize)
+{
+    this->pool = pool;
+    this->table = table;
+    this->keyColumns = keyColumns;
+    this->columns = columns == "*" ? table + ".*" : columns;
+    this->chunkSize = chunkSize > 0 ? chunkSize : 1;
+    this->done = false;
+}
+
+/**
+ * @brief Fetch the next chunk of rows after the last key seen.
+ *
+ * @param rows replaced by the chunk, the requested columns without the key.
+ * @param error set if no connection was available or the query failed;
+ * the scan can be retried from the same position.
+ *
+ * @returns false once the table is exhausted or on error.
+ */
+bool TableScanner::Next(std::vector<std::vector<std::string>> &rows, std::string &error)
+{
+    rows.clear();
+    if (done)
+        return false;
+    if (keyColumns.empty())
+    {
+        error = "ERROR: Table scan needs at least one key column.";
+        return false;
+    }
+    if (!lastKey.empty() && lastKey.size() != keyColumns.size())
+    {
+        error = "ERROR: Table scan position does not match the key columns.";
+        return false;
+    }
+
+    SQLConnection *sqlPtr = pool->GetConnecion();
+    if (sqlPtr == nullptr)
+    {
+        error = "ERROR: No connection available for table scan.";
+        return false;
+    }
+
+    QueryBuilder query(sqlPtr);
+    query.append("SELECT ");
+    for (const auto &key : keyColumns)
+        query.identifier(key).append(", ");
+    query.append(columns).append(" FROM ").append(table);
+
+    if (!lastKey.empty())
+    {
+        // k1 > v1 OR (k1 = v1 AND k2 > v2) OR ..., spelled out because the
+        // optimizer does not always turn (k1, k2) > (v1, v2) into a range
+        query.append(" WHERE ");
+        for (size_t i = 0; i < keyColumns.size(); i++)
+        {
+            if (i > 0)
+                query.append(" OR ");
+            query.append("(");
+            for (size_t j = 0; j < i; j++)
+                query.identifier(keyColumns[j]).append(" = ").value(lastKey[j]).append(" AND ");
+            query.identifier(keyColumns[i]).append(" > ").value(lastKey[i]).append(")");
+        }
+    }
+
+    query.append(" ORDER BY ");
+    for (size_t i = 0; i < keyColumns.size(); i++)
+    {
+        if (i > 0)
+            query.append(", ");
+        query.identifier(keyColumns[i]);
+    }
+    query.append(" LIMIT ").value((unsigned long long)chunkSize);
+
+    std::string queryError;
+    auto chunk = query.select(queryError);
+    pool->ReleaseConnecion(sqlPtr);
+    if (!queryError.empty())
+    {
+        error = queryError;
+        return false;
+    }
+
+    if (chunk.size() < chunkSize)
+        done = true;
+    if (chunk.empty())
+        return false;
+
+    size_t keyCount = keyColumns.size();
+    lastKey.assign(chunk.back().begin(), chunk.back().begin() + keyCount);
+    rows.reserve(chunk.size());
+    for (auto &row : chunk)
+        rows.emplace_back(std::make_move_iterator(row.begin() + keyCount),
+                          std::make_move_iterator(row.end()));
+    return true;
+}
+
+bool TableScanner::Done()
+{
+    return done;
+}
+
+/**
+ * @brief Resume after the given key, e.g. one saved from LastKey by an
+ * earlier run.
+ */
+void TableScanner::Seek(const std::vector<std::string> &lastKey)
+{
+    this->lastKey = lastKey;
+    this->done = false;
+}
+
+/**
+ * @brief Restart from the beginning of the table.
+ */
+void TableScanner::Reset()
+{
+    lastKey.clear();
+    done = false;
+}
+
+/**
+ * @brief Key of the last row returned, empty before the first chunk.
+ */
+const std::vector<std::string> &TableScanner::LastKey()
+{
+    return lastKey;
+}
@@ -0,0 +1,53 @@
+#ifndef TABLE_SCANNER_H__ // #include guards
+#define TABLE_SCANNER_H__
+
+/* walks a whole table in key order, one bounded chunk per query */
+
+#include <string>
+#include <vector>
+
+#include "ConnectionPool.h"
+
+/**
+ * Keyset pagination over a table's primary (or any unique, non-null) key:
+ *     SELECT keys, columns FROM table
+ *     WHERE (k1 > last1) OR (k1 = last1 AND k2 > last2)
+ *     ORDER BY k1, k2 LIMIT chunkSize
+ * Each chunk costs an index range read no matter how far the scan has got,
+ * unlike LIMIT/OFFSET. A connection is leased for one chunk at a time, so
+ * other work on the pool interleaves with the scan.
+ *
+ *     TableScanner scan(&pool, "shop.orders", {"customer_id", "id"}, "total");
+ *     std::vector<std::vector<std::string>> rows;
+ *     while (scan.Next(rows, error))
+ *         process(rows);
+ */
+class TableScanner
+{
+public:
+    TableScanner(
+        ConnectionPool *pool, const std::string &table,
+        const std::vector<std::string> &keyColumns,
+        const std::string &columns = "*",
+        unsigned int chunkSize = DEFAULT_CHUNK_SIZE);
+
+    static const unsigned int DEFAULT_CHUNK_SIZE = 1000;
+
+    bool Next(std::vector<std::vector<std::string>> &rows, std::string &error);
+    bool Done();
+    void Seek(const std::vector<std::string> &lastKey);
+    void Reset();
+    const std::vector<std::string> &LastKey();
+
+private:
+    ConnectionPool *pool;
+    std::string table;
+    std::vector<std::string> keyColumns;
+    std::string columns;
+    unsigned int chunkSize;
+
+    std::vector<std::string> lastKey; // empty before the first chunk
+    bool done;
+};
+
+#endif